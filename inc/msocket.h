@@ -26,11 +26,14 @@ extern "C" {
 #else
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
 #endif
 #include "osmacro.h"
 #include "msocket_adt.h"
+#include "msocket_timer.h"
+#include "msocket_framer.h"
 
 /**************************** Constants and Types ****************************/
 
@@ -50,9 +53,29 @@ extern "C" {
 
 #define MSOCKET_RCV_BUF_GROW_SIZE (8*1024)
 #define MSOCKET_MIN_RCV_BUF_SIZE (MSOCKET_RCV_BUF_GROW_SIZE)
+#define MSOCKET_RX_SIZE_MIN (2*1024) //default lower bound of the adaptive receive size
+#define MSOCKET_RX_SIZE_MAX (256*1024) //default upper bound of the adaptive receive size
+#define MSOCKET_RX_SHRINK_MS 1000 //receive size is halved after this long without a full read
+
+#define MSOCKET_DEFAULT_BACKLOG SOMAXCONN
+#define MSOCKET_ACCEPT_BATCH_MAX 64 //maximum number of connections accepted per readiness event of a listening socket
+#define MSOCKET_UDP_BATCH_MAX 32 //maximum number of datagrams received per readiness event of a UDP socket (recvmmsg, Linux)
+
+#define MSOCKET_SEND_HIGH_WATERMARK (1024*1024) //default number of queued bytes above which producers should wait for tcp_writable
+#define MSOCKET_SEND_LOW_WATERMARK (256*1024) //default number of queued bytes at or below which tcp_writable is triggered
+#define MSOCKET_ZEROCOPY_THRESHOLD (64*1024) //recommended zero-copy threshold, smaller buffers are cheaper to copy
+#define MSOCKET_RX_PAUSE 1 //return value of tcp_message and tcp_data_batch that pauses reading, see msocket_resume_read
 
 struct msocket_t;
 struct msocket_server_tag;
+struct msocket_reactor_tag;
+struct msocket_workpool_tag;
+struct msocket_workitem_tag;
+struct msocket_txitem_tag;
+struct msocket_zcitem_tag;
+struct msocket_group_tag;
+struct msocket_rxblock_tag;
+struct msocket_udpbatch_tag;
 
 /********************** About Address Family ***************************
 * Supported families:
@@ -64,15 +87,44 @@ struct msocket_server_tag;
 * Above defines are located in system header files (implicitly included).
 ************************************************************************/
 
+/**
+ * Datagram passed to udp_msg_batch. The sender address is left in binary form, inet_ntop converts it when needed.
+ */
+typedef struct msocket_datagram_tag{
+   const uint8_t *data;
+   uint32_t len;
+   const struct sockaddr *addr;
+   uint32_t addrLen;
+} msocket_datagram_t;
+
 typedef struct msocket_handler_t{
-   void (*tcp_accept)(void *arg, struct msocket_server_tag *srv,struct msocket_t *msocket);
+   void (*tcp_accept)(void *arg, struct msocket_server_tag *srv,struct msocket_t *msocket); //srv is NULL when triggered by a listening msocket served by msocket_start_io
    void (*udp_msg)(void *arg, const char *addr, uint16_t port, const uint8_t *dataBuf, uint32_t dataLen);
    void (*tcp_connected)(void *arg, const char *addr, uint16_t port);
    void (*tcp_disconnected)(void *arg);
-   int8_t (*tcp_data)(void *arg, const uint8_t *dataBuf, uint32_t dataLen, uint32_t *parseLen); //return 0 on success, -1 on failure (this will force the socket to close)
+   int8_t (*tcp_data)(void *arg, const uint8_t *dataBuf, uint32_t dataLen, uint32_t *parseLen); //return 0 on success, non-zero on failure (this will force the socket to close). Call msocket_pause_read to pause reading after parseLen bytes
    void (*tcp_inactivity)(uint32_t elapsed);
+   void (*tcp_idle)(void *arg, uint32_t elapsed); //same as tcp_inactivity but with handler argument
+   void (*tcp_connect_failed)(void *arg, int error); //msocket_connect_async failed, error is an errno value (ETIMEDOUT when the deadline passed)
+   void (*tcp_writable)(void *arg); //send queue went above high watermark and has now drained to the low watermark
+   void (*tcp_send_complete)(void *arg, uint32_t cookie); //kernel no longer references the buffer passed to msocket_send_zerocopy
+   int8_t (*tcp_message)(void *arg, const uint8_t *data, uint32_t len); //one complete message, used instead of tcp_data when framing is set (msocket_set_length_framing, msocket_set_delimiter_framing). Return -1 to close the socket or MSOCKET_RX_PAUSE to pause reading after this message
+   int8_t (*tcp_data_batch)(void *arg, const msocket_frame_t *frames, uint32_t numFrames); //all complete messages of one receive in a single call, used instead of tcp_message when set. Frames are only valid during the call. Return -1 to close the socket or MSOCKET_RX_PAUSE to pause reading after these messages
+   void (*udp_msg_batch)(void *arg, const msocket_datagram_t *datagrams, uint32_t numDatagrams); //all datagrams of one readiness event (up to MSOCKET_UDP_BATCH_MAX), used instead of udp_msg when set. Only valid during the call
 } msocket_handler_t;
 
+/**
+ * Immutable reference-counted buffer, lets the same data be queued on many sockets without copying it (msocket_send_buf).
+ * Created with a reference count of 1, freed when the last reference is released by msocket_buf_unref.
+ * A buffer returned by msocket_rx_retain refers to received data in place and keeps the receive buffer it is part of alive.
+ */
+typedef struct msocket_buf_tag{
+   ATOMIC_COUNTER_T refCount;
+   uint32_t len;
+   uint8_t *data;
+   struct msocket_rxblock_tag *block; //receive buffer that data points into, NULL when data follows this header
+} msocket_buf_t;
+
 typedef struct msocketAddrInfo_t{
    uint16_t port;
    char addr[MSOCKET_ADDRSTRLEN];
@@ -88,7 +140,7 @@ typedef struct msocket_t{
 #endif
    msocketAddrInfo_t tcpInfo;
    msocketAddrInfo_t udpInfo;
-   msocket_bytearray_t tcpRxBuf;
+   msocket_bytequeue_t tcpRxBuf;
    msocket_handler_t *handlerTable;
    void *handlerArg;
    uint8_t state; //TCP socket state
@@ -97,8 +149,73 @@ typedef struct msocket_t{
    uint8_t newConnection;
    uint32_t inactivityMs;
    uint32_t inactivityCallMs;
+   uint32_t lastActivityMs; //timestamp of last send or receive
    uint8_t addressFamily;
+   struct msocket_reactor_tag *reactor; //when set, I/O is served by the reactor instead of ioThread
+   void *reactorHandle;
+   uint8_t reusePort;
+#ifndef _WIN32
+   int wakeupfd[2]; //wakes up ioThread when socket is closed (read end, write end)
+#endif
+   struct msocket_timerwheel_tag *timerWheel; //timer wheel of the I/O driver currently serving the socket
+   msocket_timer_t *timers; //running timers of this socket
+   msocket_timer_t inactivityTimer;
+   msocket_timer_t connectTimer;
+   uint32_t connectTimeoutMs; //deadline of msocket_connect_async, 0 means no deadline
+   int backlog; //used by msocket_listen and msocket_unix_listen
+   struct msocket_txitem_tag *txHead; //send queue, protected by mutex
+   struct msocket_txitem_tag *txTail;
+   uint32_t txQueued; //number of bytes in send queue
+   uint32_t txHighWater;
+   uint32_t txLowWater;
+   uint8_t txBlocked; //txQueued went above txHighWater, tcp_writable is pending
+   uint8_t txSending; //items from the head of the send queue are in an io_uring send of the reactor, see msocket_ioSendBegin
+   msocket_timer_t rxShrinkTimer;
+   uint32_t rxSize; //bytes requested per receive, doubles on full reads and is halved after a quiet period
+   uint32_t rxSizeMin;
+   uint32_t rxSizeMax;
+   uint8_t rxBusy; //a receive filled the requested size since rxShrinkTimer was started
+   uint32_t rxBudget; //messages delivered per wakeup of the I/O driver, 0 means no limit
+   uint32_t rxBudgetLeft;
+   uint8_t rxBacklog; //read budget ran out while complete messages were left in tcpRxBuf
+   struct msocket_rxblock_tag *rxBlock; //receive buffer lent out by msocket_rx_retain during the current callback
+   uint8_t rxPaused; //bit mask of reasons reading is paused for, protected by mutex
+   uint8_t rxResumed; //reading was resumed, messages left in tcpRxBuf are delivered before the next receive (protected by mutex)
+   uint32_t rxLimit; //maximum number of received bytes waiting for the handler, 0 means no limit
+   uint32_t rxQueued; //received bytes handed to the workpool and not yet consumed by the handler, protected by mutex
+   msocket_framer_t framer; //splits received data into messages for tcp_message
+   struct msocket_group_tag *group; //group this socket is a member of, see msocket_group_add
+   struct msocket_t *groupNext;
+   struct msocket_t *groupPrev;
+#ifdef __linux__
+   uint32_t zcThreshold; //minimum size for MSG_ZEROCOPY sends, 0 means zero-copy is disabled
+   uint32_t zcNextId; //kernel sequence number of next MSG_ZEROCOPY send
+   struct msocket_zcitem_tag *zcHead; //zero-copy sends waiting for completion, protected by mutex
+   struct msocket_zcitem_tag *zcTail;
+   struct msocket_udpbatch_tag *udpBatch; //recvmmsg buffers, allocated by the first UDP receive
+#endif
+#ifndef _WIN32
+   struct msocket_workpool_tag *workpool; //when set, tcp_data and tcp_disconnected run on a worker thread of the pool
+   struct msocket_workitem_tag *workHead; //work waiting for a worker, protected by workpool mutex
+   struct msocket_workitem_tag *workTail;
+   struct msocket_t *workNext; //run queue of workpool
+   THREAD_T workThread; //worker currently processing the socket
+   uint8_t workState;
+   uint8_t workHeld; //workHead did not fit into the paused rx ring and waits for msocket_resume_read, protected by workpool mutex
+   uint8_t workFailed; //tcp_data failed on worker thread, remaining work is discarded
+   uint8_t workDisconnected; //peer disconnected while reading was paused, tcp_disconnected follows the messages left in tcpRxBuf
+#endif
 }msocket_t;
+
+/**
+ * Set of sockets that can be sent to with a single call (msocket_group_send_buf).
+ * A socket leaves the group automatically when it is destroyed.
+ */
+typedef struct msocket_group_tag{
+   MUTEX_T mutex;
+   msocket_t *head;
+   uint32_t numSockets;
+} msocket_group_t;
 /********************************* Functions *********************************/
 int8_t msocket_create(msocket_t *self,uint8_t addressFamily);
 void msocket_destroy(msocket_t *self);
@@ -106,19 +223,64 @@ msocket_t *msocket_new(uint8_t addressFamily);
 void msocket_delete(msocket_t *self);
 void msocket_vdelete(void *arg);
 void msocket_close(msocket_t *self);
+void msocket_set_reuse_port(msocket_t *self, uint8_t enable);
+void msocket_set_backlog(msocket_t *self, int backlog);
 int8_t msocket_listen(msocket_t *self, uint8_t mode, const uint16_t port, const char *addr);
 #ifndef _WIN32
 int8_t msocket_unix_listen(msocket_t *self, const char *socket_path);
 #endif
 msocket_t *msocket_accept(msocket_t *self, msocket_t *child);
 void msocket_set_handler(msocket_t *self, const msocket_handler_t *handlerTable, void *handlerArg);
+#ifdef __linux__
+void msocket_set_reactor(msocket_t *self, struct msocket_reactor_tag *reactor);
+#endif
+#ifndef _WIN32
+void msocket_set_workpool(msocket_t *self, struct msocket_workpool_tag *workpool);
+#endif
+int8_t msocket_set_rx_size(msocket_t *self, uint32_t minSize, uint32_t maxSize);
+void msocket_set_read_budget(msocket_t *self, uint32_t maxMessages);
+void msocket_set_rx_limit(msocket_t *self, uint32_t maxBuffered);
+void msocket_pause_read(msocket_t *self);
+void msocket_resume_read(msocket_t *self);
+int8_t msocket_set_length_framing(msocket_t *self, const msocket_length_framing_t *config);
+int8_t msocket_set_delimiter_framing(msocket_t *self, const msocket_delimiter_framing_t *config);
+#ifdef __linux__
+int8_t msocket_set_rx_ring(msocket_t *self, uint32_t size);
+#endif
 int8_t msocket_start_io(msocket_t *self);
 
 int8_t msocket_connect(msocket_t *self, const char *addr, uint16_t port);
+int8_t msocket_connect_async(msocket_t *self, const char *addr, uint16_t port, uint32_t timeoutMs);
 int8_t msocket_unix_connect(msocket_t *self, const char *socketPath);
 int8_t msocket_send_to(msocket_t *self, const char *addr, uint16_t port, const void *msgData, uint32_t msgLen);
 int8_t msocket_send(msocket_t *self, const void *msgData, uint32_t msgLen);
+#ifndef _WIN32
+int8_t msocket_sendv(msocket_t *self, const struct iovec *iov, int iovcnt);
+int8_t msocket_send_tov(msocket_t *self, const char *addr, uint16_t port, const struct iovec *iov, int iovcnt);
+#endif
+int8_t msocket_send_buf(msocket_t *self, msocket_buf_t *buf);
+void msocket_set_send_watermarks(msocket_t *self, uint32_t lowWater, uint32_t highWater);
+#ifdef __linux__
+int8_t msocket_set_zerocopy(msocket_t *self, uint32_t threshold);
+int8_t msocket_send_zerocopy(msocket_t *self, const void *msgData, uint32_t msgLen, uint32_t cookie);
+int8_t msocket_send_file(msocket_t *self, int fd, off_t offset, size_t len);
+#endif
+uint32_t msocket_send_queue_size(msocket_t *self);
 int8_t msocket_state(msocket_t *self);
+int8_t msocket_timer_start(msocket_t *self, msocket_timer_t *timer, uint32_t timeoutMs, msocket_timer_cb_t *callback);
+void msocket_timer_cancel(msocket_t *self, msocket_timer_t *timer);
+
+msocket_buf_t *msocket_buf_new(const void *data, uint32_t len);
+msocket_buf_t *msocket_buf_ref(msocket_buf_t *self);
+void msocket_buf_unref(msocket_buf_t *self);
+msocket_buf_t *msocket_rx_retain(msocket_t *self, const uint8_t *data, uint32_t len);
+
+void msocket_group_create(msocket_group_t *self);
+void msocket_group_destroy(msocket_group_t *self);
+void msocket_group_add(msocket_group_t *self, msocket_t *msocket);
+void msocket_group_remove(msocket_t *msocket);
+uint32_t msocket_group_num_sockets(msocket_group_t *self);
+uint32_t msocket_group_send_buf(msocket_group_t *self, msocket_buf_t *buf);
 
 //backwards compatibility
 #define msocket_sethandler(s, t, a) msocket_set_handler(s, t, a)
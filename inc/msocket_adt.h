@@ -43,6 +43,22 @@ typedef struct msocket_bytearray_tag
    uint32_t u32GrowSize;
 } msocket_bytearray_t;
 
+/**
+ * Byte queue with a read cursor. Consuming bytes from the front only moves the cursor, the remaining bytes are moved
+ * to the start of the buffer (compacted) only when space is needed at the end.
+ * A queue created with msocket_bytequeue_createRing is instead a fixed size ring buffer whose memory is mapped twice,
+ * back to back, so data and tail are always contiguous even when they wrap around the end of the ring (Linux only).
+ */
+typedef struct msocket_bytequeue_tag
+{
+   uint8_t* pData;
+   uint32_t u32ReadPos;  //offset of first unconsumed byte
+   uint32_t u32WritePos; //offset of first unused byte
+   uint32_t u32AllocLen;
+   uint32_t u32GrowSize;
+   bool isRing;
+} msocket_bytequeue_t;
+
 typedef struct msocket_ary_tag
 {
    void** ppAlloc;		       //array of (void*)
@@ -57,6 +73,8 @@ typedef struct msocket_ary_tag
 #define MSOCKET_BYTEARRAY_NO_GROWTH 0u  //will malloc exactly the number of bytes it currently needs
 #define MSOCKET_BYTEARRAY_DEFAULT_GROW_SIZE ((uint32_t)8192u)
 #define MSOCKET_BYTEARRAY_MAX_GROW_SIZE ((uint32_t)32u*1024u*1024u)
+#define MSOCKET_BYTEARRAY_SHRINK_SIZE ((uint32_t)1024u*1024u) //allocations above this are given back by trimLeft once at most a quarter is in use
+#define MSOCKET_BYTEQUEUE_MAX_RING_SIZE ((uint32_t)1024u*1024u*1024u)
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -66,12 +84,28 @@ void msocket_bytearray_create(msocket_bytearray_t* self, uint32_t u32GrowSize);
 void msocket_bytearray_destroy(msocket_bytearray_t* self);
 msocket_adt_error_t msocket_bytearray_reserve(msocket_bytearray_t* self, uint32_t u32NewLen);
 msocket_adt_error_t msocket_bytearray_grow(msocket_bytearray_t* self, uint32_t u32MinLen);
+msocket_adt_error_t msocket_bytearray_shrink(msocket_bytearray_t* self, uint32_t u32MaxFree);
 msocket_adt_error_t msocket_bytearray_append(msocket_bytearray_t* self, const uint8_t* pData, uint32_t u32DataLen);
 msocket_adt_error_t msocket_bytearray_trimLeft(msocket_bytearray_t* self, const uint8_t* pSrc);
 uint8_t* msocket_bytearray_data(const msocket_bytearray_t* self);
 uint32_t msocket_bytearray_length(const msocket_bytearray_t* self);
 void msocket_bytearray_clear(msocket_bytearray_t* self);
 
+void msocket_bytequeue_create(msocket_bytequeue_t* self, uint32_t u32GrowSize);
+msocket_adt_error_t msocket_bytequeue_createRing(msocket_bytequeue_t* self, uint32_t u32Size);
+void msocket_bytequeue_destroy(msocket_bytequeue_t* self);
+msocket_adt_error_t msocket_bytequeue_reserveTail(msocket_bytequeue_t* self, uint32_t u32MinFree);
+msocket_adt_error_t msocket_bytequeue_shrink(msocket_bytequeue_t* self, uint32_t u32MaxFree);
+uint8_t* msocket_bytequeue_tail(const msocket_bytequeue_t* self);
+uint32_t msocket_bytequeue_tailLength(const msocket_bytequeue_t* self);
+msocket_adt_error_t msocket_bytequeue_commit(msocket_bytequeue_t* self, uint32_t u32DataLen);
+msocket_adt_error_t msocket_bytequeue_append(msocket_bytequeue_t* self, const uint8_t* pData, uint32_t u32DataLen);
+msocket_adt_error_t msocket_bytequeue_consume(msocket_bytequeue_t* self, uint32_t u32DataLen);
+uint8_t* msocket_bytequeue_data(const msocket_bytequeue_t* self);
+uint32_t msocket_bytequeue_length(const msocket_bytequeue_t* self);
+void msocket_bytequeue_clear(msocket_bytequeue_t* self);
+uint8_t* msocket_bytequeue_swap(msocket_bytequeue_t* self, uint8_t* pNewData, uint32_t u32NewLen);
+
 void msocket_ary_create(msocket_ary_t* self, void (*pDestructor)(void*));
 void msocket_ary_destroy(msocket_ary_t* self);
 msocket_adt_error_t msocket_ary_push(msocket_ary_t* self, void* pElem);
@@ -0,0 +1,73 @@
+/*****************************************************************************
+* \file:    msocket_framer.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Message framing of received TCP data (used by msocket when tcp_message or tcp_data_batch is set)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_FRAMER_H
+#define MSOCKET_FRAMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include <stdint.h>
+
+/**************************** Constants and Types ****************************/
+
+#define MSOCKET_FRAMER_NONE      0u //received data is passed to tcp_data
+#define MSOCKET_FRAMER_LENGTH    1u //length-prefixed messages, see msocket_length_framing_t
+#define MSOCKET_FRAMER_DELIMITER 2u //messages terminated by a delimiter byte, see msocket_delimiter_framing_t
+
+#define MSOCKET_LENGTH_VARINT    0u //headerSize of an unsigned LEB128 varint length header (1 to 5 bytes)
+#define MSOCKET_FRAME_SIZE_MAX   (16u*1024u*1024u) //default maxFrameSize
+#define MSOCKET_FRAME_BATCH_MAX  256u //messages passed to one msocket_batch_cb_t call at most
+
+typedef struct msocket_frame_tag{
+   const uint8_t *data;
+   uint32_t len;
+} msocket_frame_t;
+
+typedef int8_t (msocket_message_cb_t)(void *arg, const uint8_t *data, uint32_t len);
+typedef int8_t (msocket_batch_cb_t)(void *arg, const msocket_frame_t *frames, uint32_t numFrames);
+
+typedef struct msocket_length_framing_tag{
+   uint8_t headerSize; //1, 2 or 4 byte length header, or MSOCKET_LENGTH_VARINT
+   uint8_t bigEndian; //byte order of 2 and 4 byte headers
+   uint8_t includesHeader; //length value counts the header bytes as well as the message
+   uint32_t maxFrameSize; //larger frames (header included) close the connection, 0 means MSOCKET_FRAME_SIZE_MAX
+} msocket_length_framing_t;
+
+typedef struct msocket_delimiter_framing_tag{
+   uint8_t delimiter; //e.g. '\n' or '\0', not included in the message passed to the callback
+   uint32_t maxFrameSize; //longer records (delimiter included) close the connection, 0 means MSOCKET_FRAME_SIZE_MAX
+} msocket_delimiter_framing_t;
+
+typedef struct msocket_framer_tag{
+   uint8_t type; //MSOCKET_FRAMER_XXX
+   msocket_length_framing_t length;
+   msocket_delimiter_framing_t delimiter;
+   uint32_t frameRemain; //bytes still missing from the incomplete frame at the end of the last decoded data, 0 when not known yet
+   uint32_t scanPos; //bytes at the start of the next decoded data already searched for the delimiter
+   uint32_t budget; //messages decode may still deliver, it stops at a message boundary when this reaches 0
+} msocket_framer_t;
+
+/********************************* Functions *********************************/
+void msocket_framer_create(msocket_framer_t *self);
+int8_t msocket_framer_set_length(msocket_framer_t *self, const msocket_length_framing_t *config);
+int8_t msocket_framer_set_delimiter(msocket_framer_t *self, const msocket_delimiter_framing_t *config);
+int8_t msocket_framer_decode(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_message_cb_t *callback, void *arg);
+int8_t msocket_framer_decode_batch(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_batch_cb_t *callback, void *arg);
+uint32_t msocket_framer_remain(const msocket_framer_t *self);
+void msocket_framer_reset(msocket_framer_t *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_FRAMER_H
@@ -0,0 +1,77 @@
+/*****************************************************************************
+* \file:    msocket_reactor.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Shared epoll event loop serving many msocket objects from one thread (Linux only)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_REACTOR_H
+#define MSOCKET_REACTOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include <stdint.h>
+#include "osmacro.h"
+#include "msocket.h"
+
+#ifdef __linux__
+/**************************** Constants and Types ****************************/
+
+#define MSOCKET_REACTOR_MAX_EVENTS 64
+
+#define MSOCKET_REACTOR_BACKEND_EPOLL      0u
+#define MSOCKET_REACTOR_BACKEND_IO_URING   1u //requires library to be built with CMake option MSOCKET_IO_URING
+
+struct msocket_reactor_handle_tag;
+struct msocket_reactor_uring_tag;
+
+/**
+ * A reactor runs the I/O of many msocket objects on a single thread.
+ * Sockets are attached to a reactor by calling msocket_set_reactor before msocket_start_io (or msocket_connect etc.).
+ * The handler callbacks in msocket_handler_t are triggered exactly as they would be from the per-socket ioTask thread.
+ */
+typedef struct msocket_reactor_tag{
+   int epollfd;
+   int wakeupfd;
+   THREAD_T thread;
+   MUTEX_T mutex;
+   pthread_cond_t cond;
+   struct msocket_reactor_handle_tag *handles; //sockets currently served by this reactor
+   struct msocket_reactor_handle_tag *pending; //sockets waiting for tcp_connected to be called
+   struct msocket_reactor_handle_tag *garbage; //detached handles, freed after current batch of events
+   struct msocket_reactor_handle_tag *backlog; //sockets whose read budget ran out, served once per loop iteration
+   struct msocket_reactor_handle_tag *backlogTail;
+   msocket_t *current; //socket currently being dispatched
+   uint8_t *recvBuf;
+   struct msocket_reactor_uring_tag *uring; //only used by io_uring backend
+   msocket_timerwheel_t timers; //timers of all served sockets, protected by mutex
+   uint32_t numSockets;
+   uint32_t numBacklog;
+   uint8_t threadRunning;
+   uint8_t stopRequest;
+   uint8_t backend;
+}msocket_reactor_t;
+
+/********************************* Functions *********************************/
+int8_t msocket_reactor_create(msocket_reactor_t *self);
+void msocket_reactor_destroy(msocket_reactor_t *self);
+msocket_reactor_t *msocket_reactor_new(void);
+void msocket_reactor_delete(msocket_reactor_t *self);
+int8_t msocket_reactor_start(msocket_reactor_t *self);
+void msocket_reactor_stop(msocket_reactor_t *self);
+uint32_t msocket_reactor_num_sockets(msocket_reactor_t *self);
+int8_t msocket_reactor_set_backend(msocket_reactor_t *self, uint8_t backend);
+uint8_t msocket_reactor_backend(msocket_reactor_t *self);
+#endif //__linux__
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_REACTOR_H
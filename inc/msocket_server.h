@@ -21,14 +21,20 @@ extern "C" {
 #include <pthread.h>
 #endif
 
+#define MSOCKET_SERVER_SHARDS_AUTO 0xFFFFFFFFu //one shard per online CPU core
+#define MSOCKET_SERVER_BACKEND_DEFAULT 0xFFu //use default backend of msocket_reactor_t
+
+struct msocket_server_shard_tag;
+struct msocket_workpool_tag;
+
 typedef struct msocket_server_tag{
-   msocket_t *acceptSocket;
+   msocket_t *acceptSocket; //listening socket of the classic server, served by msocket_start_io
+   msocket_t *udpSocket; //UDP socket of the classic server
    uint16_t tcpPort;
    uint16_t udpPort;
    char *udpAddr;
    char *socketPath;
    msocket_ary_t cleanupItems;
-   THREAD_T acceptThread;
    THREAD_T cleanupThread;
    SEMAPHORE_T sem;
    MUTEX_T mutex;
@@ -37,8 +43,15 @@ typedef struct msocket_server_tag{
    void *handlerArg;
    msocket_handler_t handlerTable;
    void (*pDestructor)(void *arg);
+   struct msocket_server_shard_tag *shards; //each shard runs its own reactor thread with its own SO_REUSEPORT listening socket
+   uint32_t numShards;
+   uint8_t reactorBackend; //MSOCKET_REACTOR_BACKEND_XXX used by shards
+   int backlog; //backlog of listening sockets, see msocket_set_backlog
+   msocket_group_t connections; //accepted connections, target of msocket_server_broadcast
+#ifndef _WIN32
+   struct msocket_workpool_tag *workpool; //given to accepted connections
+#endif
 #ifdef _WIN32
-   unsigned int acceptThreadId;
    unsigned int cleanupThreadId;
 #endif
 }msocket_server_t;
@@ -52,9 +65,17 @@ msocket_server_t *msocket_server_new(uint8_t addressFamily, void (*pDestructor)(
 void msocket_server_delete(msocket_server_t *self);
 void msocket_server_set_handler(msocket_server_t *self, const msocket_handler_t *handler, void *handlerArg);
 void msocket_server_start(msocket_server_t *self, const char *udpAddr, uint16_t udpPort,uint16_t tcpPort);
+int8_t msocket_server_start_shards(msocket_server_t *self, const char *udpAddr, uint16_t udpPort, uint16_t tcpPort, uint32_t numShards);
+void msocket_server_set_reactor_backend(msocket_server_t *self, uint8_t backend);
+void msocket_server_set_backlog(msocket_server_t *self, int backlog);
+#ifndef _WIN32
+void msocket_server_set_workpool(msocket_server_t *self, struct msocket_workpool_tag *workpool);
+#endif
 void msocket_server_unix_start(msocket_server_t *self, const char *socketPath);
 void msocket_server_disable_cleanup(msocket_server_t *self);
 void msocket_server_cleanup_connection(msocket_server_t *self, void *arg);
+uint32_t msocket_server_broadcast(msocket_server_t *self, msocket_buf_t *buf);
+uint32_t msocket_server_num_connections(msocket_server_t *self);
 
 //backwards compatibility
 #define msocket_server_sethandler(s, t, a) msocket_server_set_handler(s, t, a)
@@ -0,0 +1,66 @@
+/*****************************************************************************
+* \file:    msocket_timer.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Hierarchical timer wheel used by the msocket I/O drivers
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_TIMER_H
+#define MSOCKET_TIMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include <stdint.h>
+
+/**************************** Constants and Types ****************************/
+
+#define MSOCKET_TIMER_LEVEL_BITS   6u
+#define MSOCKET_TIMER_LEVEL_SIZE   (1u << MSOCKET_TIMER_LEVEL_BITS)
+#define MSOCKET_TIMER_LEVELS       4u //one tick is 1 ms, timers further away than 2^24 ms (4.6 hours) are re-cascaded until due
+#define MSOCKET_TIMER_INFINITE     0xFFFFFFFFu
+
+struct msocket_timer_tag;
+typedef void (msocket_timer_cb_t)(void *arg, struct msocket_timer_tag *timer);
+
+/**
+ * Timer memory is owned by the user. Members are managed by the library, use msocket_timer_start/msocket_timer_cancel.
+ */
+typedef struct msocket_timer_tag{
+   struct msocket_timer_tag *next; //timer wheel slot
+   struct msocket_timer_tag **pprev; //NULL when timer is not running
+   struct msocket_timer_tag *ownerNext; //all running timers of same owner
+   struct msocket_timer_tag **ownerPprev;
+   msocket_timer_cb_t *callback;
+   void *owner;
+   uint32_t expires;
+}msocket_timer_t;
+
+typedef struct msocket_timerwheel_tag{
+   msocket_timer_t *slots[MSOCKET_TIMER_LEVELS][MSOCKET_TIMER_LEVEL_SIZE];
+   msocket_timer_t *expired; //timers that are due but not yet returned by msocket_timerwheel_expire
+   uint32_t current; //next tick to process
+   uint32_t numTimers;
+}msocket_timerwheel_t;
+
+/********************************* Functions *********************************/
+void msocket_timer_init(msocket_timer_t *timer);
+uint8_t msocket_timer_is_running(const msocket_timer_t *timer);
+
+void msocket_timerwheel_create(msocket_timerwheel_t *self, uint32_t now);
+void msocket_timerwheel_add(msocket_timerwheel_t *self, msocket_timer_t *timer, uint32_t expires, msocket_timer_t **ownerList);
+void msocket_timerwheel_remove(msocket_timerwheel_t *self, msocket_timer_t *timer);
+void msocket_timerwheel_remove_all(msocket_timerwheel_t *self, msocket_timer_t **ownerList);
+msocket_timer_t *msocket_timerwheel_expire(msocket_timerwheel_t *self, uint32_t now);
+uint32_t msocket_timerwheel_next(msocket_timerwheel_t *self, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_TIMER_H
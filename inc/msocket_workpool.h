@@ -0,0 +1,73 @@
+/*****************************************************************************
+* \file:    msocket_workpool.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Fixed pool of worker threads running tcp_data/tcp_disconnected callbacks (Linux/Unix only)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_WORKPOOL_H
+#define MSOCKET_WORKPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include <stdint.h>
+#include "osmacro.h"
+#include "msocket.h"
+
+#ifndef _WIN32
+/**************************** Constants and Types ****************************/
+
+#define MSOCKET_WORKPOOL_DEFAULT_THREADS  4u
+#define MSOCKET_WORKPOOL_MAX_THREADS      256u
+#define MSOCKET_WORKPOOL_BATCH_SIZE       16u //work items a worker processes for one socket before moving on to the next socket
+
+typedef struct msocket_workpool_stats_tag{
+   uint32_t numThreads;
+   uint32_t queueDepth; //received chunks and events not yet processed by a worker
+   uint32_t maxQueueDepth; //highest queueDepth seen since the pool was created
+   uint32_t numRunnable; //sockets waiting for a free worker
+   uint64_t numProcessed; //work items processed since the pool was created
+}msocket_workpool_stats_t;
+
+/**
+ * A workpool takes the tcp_data and tcp_disconnected callbacks off the I/O thread.
+ * Sockets are attached to a pool by calling msocket_set_workpool before msocket_start_io (or msocket_connect etc.).
+ * The I/O thread (ioThread or reactor) copies received data into the pool and goes straight back to reading from the socket.
+ * Work of one socket is processed by one worker at a time, in the order it was received. Different sockets are processed in parallel.
+ * All other callbacks (tcp_connected, timers, tcp_idle etc.) still run on the I/O thread.
+ */
+typedef struct msocket_workpool_tag{
+   THREAD_T *threads;
+   MUTEX_T mutex;
+   pthread_cond_t cond; //signalled when a socket becomes runnable or when the pool is stopped
+   pthread_cond_t idle; //signalled when a worker is done with a socket
+   msocket_t *runHead; //sockets with queued work and no worker
+   msocket_t *runTail;
+   uint32_t numThreads;
+   uint32_t numRunnable;
+   uint32_t queueDepth;
+   uint32_t maxQueueDepth;
+   uint64_t numProcessed;
+   uint8_t stopRequest;
+}msocket_workpool_t;
+
+/********************************* Functions *********************************/
+int8_t msocket_workpool_create(msocket_workpool_t *self, uint32_t numThreads);
+void msocket_workpool_destroy(msocket_workpool_t *self);
+msocket_workpool_t *msocket_workpool_new(uint32_t numThreads);
+void msocket_workpool_delete(msocket_workpool_t *self);
+uint32_t msocket_workpool_queue_depth(msocket_workpool_t *self);
+void msocket_workpool_get_stats(msocket_workpool_t *self, msocket_workpool_stats_t *stats);
+#endif //_WIN32
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_WORKPOOL_H
@@ -110,6 +110,18 @@
 #define SPINLOCK_DESTROY(spin) pthread_spin_destroy(&spin);
 #endif
 
+/* ATOMIC COUNTER */
+//include Windows.h for Windows
+#ifdef _WIN32
+#define ATOMIC_COUNTER_T volatile LONG
+#define ATOMIC_INC(counter) InterlockedIncrement(&(counter))
+#define ATOMIC_DEC(counter) InterlockedDecrement(&(counter)) //returns the new value
+#else
+#define ATOMIC_COUNTER_T uint32_t
+#define ATOMIC_INC(counter) __atomic_add_fetch(&(counter), 1u, __ATOMIC_RELAXED)
+#define ATOMIC_DEC(counter) __atomic_sub_fetch(&(counter), 1u, __ATOMIC_ACQ_REL) //returns the new value
+#endif
+
 /* SLEEP */
 // include Winsows.h for Windows, unistd.h for Linux/Cygwin
 #ifdef _WIN32
@@ -13,11 +13,22 @@
 #include <process.h>
 
 #else
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE //accept4, recvmmsg
+#endif
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
 
 #endif
 #include <errno.h>
@@ -28,6 +39,10 @@
 #define MSOCKET_DEBUG 0
 #endif
 #include "msocket.h"
+#include "msocket_internal.h"
+#ifndef _WIN32
+#include "msocket_workpool.h"
+#endif
 
 #if MSOCKET_DEBUG
 #include <stdio.h>
@@ -38,20 +53,137 @@
 #endif
 
 /****************** Constants and Types ***************************/
-#define MSG_BUF_SIZE 8192
-#define TIMEOUT_MS 50 //ms for select-function to wait for activity
-#define TIMEOUT_US (TIMEOUT_MS*1000)
+#define MSG_BUF_SIZE MSOCKET_IO_BUF_SIZE
+#define TIMEOUT_MS MSOCKET_IO_TIMEOUT_MS //ms for select-function to wait for activity (Windows)
 #define TIMEOUT_CALL_INTERVAL_MS 1000 //interval for timeout callback handler
 #define MAX_CLOSE_ATTEMPTS 20
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#define IOV_BATCH_MAX 64 //fragments passed to a single sendmsg call
+#define RX_POOL_MAX 16 //lent receive buffers kept for reuse once their last msocket_buf_t has been released
+#define RX_PAUSE_USER 1u //msocket_pause_read was called or tcp_message/tcp_data_batch returned MSOCKET_RX_PAUSE
+#define RX_PAUSE_LIMIT 2u //data handed to the workpool reached rxLimit
+
+typedef struct msocket_txitem_tag{
+   struct msocket_txitem_tag *next;
+   uint32_t len;
+   uint32_t offset; //number of bytes already sent
+   msocket_buf_t *buf; //shared buffer queued by msocket_send_buf (data is then empty)
+#ifdef __linux__
+   int fd; //file queued by msocket_send_file (data is then empty), -1 for data items
+   off_t fileOffset; //file position of first byte not yet sent
+#endif
+   uint8_t data[];
+}msocket_txitem_t;
+
+#ifdef __linux__
+typedef struct msocket_zcitem_tag{
+   struct msocket_zcitem_tag *next;
+   uint32_t lastId; //kernel sequence number of last MSG_ZEROCOPY send that used the buffer
+   uint32_t cookie;
+}msocket_zcitem_t;
+
+typedef struct msocket_udpbatch_tag{
+   struct mmsghdr msgs[MSOCKET_UDP_BATCH_MAX];
+   struct iovec iov[MSOCKET_UDP_BATCH_MAX];
+   struct sockaddr_storage addrs[MSOCKET_UDP_BATCH_MAX];
+   msocket_datagram_t datagrams[MSOCKET_UDP_BATCH_MAX];
+   uint8_t data[]; //MSOCKET_UDP_BATCH_MAX buffers of MSOCKET_IO_BUF_SIZE bytes
+}msocket_udpbatch_t;
+#endif
+
+typedef struct msocket_rxblock_tag{
+   ATOMIC_COUNTER_T refCount; //one per msocket_buf_t from msocket_rx_retain, plus one while the socket is parsing from it
+   struct msocket_rxblock_tag *next; //free list of the receive buffer pool
+   uint8_t *data;
+   uint32_t size;
+}msocket_rxblock_t;
+
+#ifndef _WIN32
+typedef struct msocket_iovcursor_tag{
+   const struct iovec *iov; //first fragment not completely sent
+   int iovcnt; //number of fragments left
+   size_t offset; //bytes of iov[0] already sent
+   uint32_t remain; //total bytes left
+}msocket_iovcursor_t;
+#endif
+
+/********************** Private Variables *************************/
+#ifndef _WIN32
+static pthread_mutex_t m_rxPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static msocket_rxblock_t *m_rxPool = 0; //receive buffers returned by msocket_buf_unref, reused by msocket_rxRenew
+static uint32_t m_rxPoolCount = 0u;
+#endif
 
 /**************** Private Function Declarations *******************/
 static THREAD_PROTO(ioTask,arg);
 static int8_t msocket_startIoThread(msocket_t *self);
 static int msocket_udpRxHandler(msocket_t *self,uint8_t *recvBuf, int len);
+#ifdef __linux__
+static int msocket_udpReceiveBatch(msocket_t *self);
+static void msocket_udpSetPeer(msocket_t *self, const struct sockaddr *addr);
+#endif
 static int msocket_tcpRxHandler(msocket_t *self,uint8_t *recvBuf, int len);
+static int msocket_tcpReceive(msocket_t *self, uint8_t *recvBuf, uint32_t bufSize);
+static void msocket_rxGrow(msocket_t *self);
+static void msocket_rxShrinkStart(msocket_t *self);
+static void msocket_rxShrinkTimeout(msocket_t *self);
+static int msocket_tcpParse(msocket_t *self, const uint8_t *data, uint32_t len);
+static int msocket_tcpParseQueue(msocket_t *self);
+static uint8_t msocket_hasDataHandler(msocket_t *self);
+static int msocket_tcpData(msocket_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen);
+static int msocket_rxRenew(msocket_t *self);
+static void msocket_rxblockUnref(msocket_rxblock_t *block);
+static uint8_t msocket_rxIsPaused(msocket_t *self);
+static void msocket_rxNotify(msocket_t *self);
+#ifndef _WIN32
+static void msocket_rxQueueUpdate(msocket_t *self, uint32_t added, uint32_t removed);
+static int8_t msocket_sendQueued(msocket_t *self, msocket_iovcursor_t *cursor, msocket_buf_t *buf, uint8_t zerocopy, uint32_t cookie);
+static int8_t msocket_iovInit(msocket_iovcursor_t *cursor, const struct iovec *iov, int iovcnt);
+static ssize_t msocket_iovSend(SOCKET_T sockfd, msocket_iovcursor_t *cursor, int flags);
+static void msocket_iovCopy(const msocket_iovcursor_t *cursor, uint8_t *dest);
+static void msocket_txNotify(msocket_t *self);
+#endif
+#ifdef __linux__
+static ssize_t msocket_sendFileChunk(SOCKET_T sockfd, int fd, off_t *offset, size_t len);
+#endif
+static void msocket_txClear(msocket_t *self);
+static void msocket_txFree(msocket_txitem_t *item);
+#ifdef __linux__
+static void msocket_zcClear(msocket_t *self);
+static void msocket_zcAppend(msocket_t *self, msocket_zcitem_t *item, uint32_t sends, uint32_t cookie);
+static void msocket_zcComplete(msocket_t *self, msocket_zcitem_t *items);
+static void msocket_zcFlush(msocket_t *self);
+#endif
 static void msocket_timeoutReset(msocket_t *self);
-static uint8_t msocket_timeoutIncrease(msocket_t *self);
-static void msocket_joinIoThread(msocket_t *self);
+static uint8_t msocket_timeoutUpdate(msocket_t *self, uint32_t *elapsed);
+static void msocket_inactivityStart(msocket_t *self);
+static void msocket_inactivityTimeout(msocket_t *self);
+static int msocket_connectComplete(msocket_t *self);
+static int msocket_connectFailed(msocket_t *self, int error);
+static uint8_t msocket_connectInProgress(void);
+static void msocket_timerLock(msocket_t *self);
+static void msocket_timerUnlock(msocket_t *self);
+static void msocket_timerNotify(msocket_t *self);
+#ifndef _WIN32
+static int8_t msocket_wakeupOpen(msocket_t *self);
+static void msocket_wakeupClose(msocket_t *self);
+static void msocket_wakeupSignal(msocket_t *self);
+static void msocket_wakeupDrain(msocket_t *self);
+#endif
+static int8_t msocket_joinIoThread(msocket_t *self);
+static uint8_t msocket_isIoThread(msocket_t *self);
+static uint8_t msocket_isServedEstablished(msocket_t *self);
+static int msocket_acceptHandler(msocket_t *self);
+static int msocket_setPeerAddress(msocket_t *child, const struct sockaddr *addr);
+static SOCK_LEN_T msocket_udpAddress(msocket_t *self, const char *addr, uint16_t port, struct sockaddr_storage *saddr);
+static void msocket_acceptComplete(msocket_t *child);
+static SOCKET_T msocket_acceptSocket(SOCKET_T sockfd, struct sockaddr *addr, SOCK_LEN_T *addrLen);
+static void msocket_setNonBlocking(SOCKET_T sockfd);
+#ifdef _WIN32
+static void msocket_setBlocking(SOCKET_T sockfd);
+#endif
 static void msocket_closeInternalSocket(msocket_t *self, uint8_t socketMode);
 static void msocket_reset(msocket_t *self);
 static void msocket_shutdownPrepare(msocket_t *self);
@@ -60,8 +192,8 @@ static int msocket_accept_inet6(msocket_t* self, msocket_t* child);
 #ifndef _WIN32
 static int msocket_accept_local(msocket_t* self, msocket_t* child);
 #endif
-static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t port);
-static int msocket_connect_inet6(msocket_t* self, const char* address, uint16_t port);
+static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t port, uint8_t async);
+static int msocket_connect_inet6(msocket_t* self, const char* address, uint16_t port, uint8_t async);
 #ifndef _WIN32
 static int msocket_connect_unix_internal(msocket_t* self, const char* socketPath);
 #endif
@@ -102,10 +234,66 @@ int8_t msocket_create(msocket_t *self, uint8_t addressFamily){
       self->udpsockfd = INVALID_SOCKET;
 #ifdef _WIN32
       self->ioThread = INVALID_HANDLE_VALUE;
+#endif
+      self->reactor = (struct msocket_reactor_tag*) 0;
+      self->reactorHandle = (void*) 0;
+      self->reusePort = 0u;
+#ifndef _WIN32
+      self->wakeupfd[0] = -1;
+      self->wakeupfd[1] = -1;
+#endif
+      self->timerWheel = (msocket_timerwheel_t*) 0;
+      self->timers = (msocket_timer_t*) 0;
+      msocket_timer_init(&self->inactivityTimer);
+      self->inactivityTimer.owner = (void*) self;
+      msocket_timer_init(&self->connectTimer);
+      self->connectTimer.owner = (void*) self;
+      self->connectTimeoutMs = 0u;
+      self->backlog = MSOCKET_DEFAULT_BACKLOG;
+      self->txHead = (msocket_txitem_t*) 0;
+      self->txTail = (msocket_txitem_t*) 0;
+      self->txQueued = 0u;
+      self->txHighWater = MSOCKET_SEND_HIGH_WATERMARK;
+      self->txLowWater = MSOCKET_SEND_LOW_WATERMARK;
+      self->txBlocked = 0u;
+      self->txSending = 0u;
+      msocket_timer_init(&self->rxShrinkTimer);
+      self->rxShrinkTimer.owner = (void*) self;
+      self->rxSize = MSOCKET_RX_SIZE_MIN;
+      self->rxSizeMin = MSOCKET_RX_SIZE_MIN;
+      self->rxSizeMax = MSOCKET_RX_SIZE_MAX;
+      self->rxBusy = 0u;
+      self->rxBudget = 0u;
+      self->rxBudgetLeft = UINT32_MAX;
+      self->rxBacklog = 0u;
+      self->rxBlock = (msocket_rxblock_t*) 0;
+      self->rxPaused = 0u;
+      self->rxResumed = 0u;
+      self->rxLimit = 0u;
+      self->rxQueued = 0u;
+      msocket_framer_create(&self->framer);
+      self->group = (struct msocket_group_tag*) 0;
+      self->groupNext = (msocket_t*) 0;
+      self->groupPrev = (msocket_t*) 0;
+#ifdef __linux__
+      self->zcThreshold = 0u;
+      self->zcNextId = 0u;
+      self->zcHead = (struct msocket_zcitem_tag*) 0;
+      self->zcTail = (struct msocket_zcitem_tag*) 0;
+      self->udpBatch = (struct msocket_udpbatch_tag*) 0;
+#endif
+#ifndef _WIN32
+      self->workpool = (struct msocket_workpool_tag*) 0;
+      self->workHead = (struct msocket_workitem_tag*) 0;
+      self->workTail = (struct msocket_workitem_tag*) 0;
+      self->workNext = (msocket_t*) 0;
+      self->workState = 0u;
+      self->workHeld = 0u;
+      self->workFailed = 0u;
+      self->workDisconnected = 0u;
 #endif
       msocket_timeoutReset(self);
-      msocket_bytearray_create(&self->tcpRxBuf, (uint32_t) MSOCKET_RCV_BUF_GROW_SIZE);
-      msocket_bytearray_reserve(&self->tcpRxBuf, MSOCKET_MIN_RCV_BUF_SIZE);
+      msocket_bytequeue_create(&self->tcpRxBuf, 0u); //allocated by the first receive, sized by rxSize
       MUTEX_INIT(self->mutex);
       return 0;
    }
@@ -114,8 +302,20 @@ int8_t msocket_create(msocket_t *self, uint8_t addressFamily){
 
 void msocket_destroy(msocket_t *self){
 	if( self != 0 ){
+      msocket_group_remove(self);
       msocket_close(self);
-      msocket_bytearray_destroy(&self->tcpRxBuf);
+#ifndef _WIN32
+      msocket_wakeupClose(self);
+#endif
+      msocket_bytequeue_destroy(&self->tcpRxBuf);
+      msocket_txClear(self);
+#ifdef __linux__
+      msocket_zcClear(self);
+      if(self->udpBatch != 0){
+         free(self->udpBatch);
+         self->udpBatch = (struct msocket_udpbatch_tag*) 0;
+      }
+#endif
       MUTEX_DESTROY(self->mutex);
       if(self->handlerTable != 0){
          free(self->handlerTable);
@@ -152,10 +352,20 @@ void msocket_vdelete(void *arg)
  * This function closes the internal socket handle and stops the internal ioThread.
  * When called from the ioThread itself (during connect/disconnect callouts) it will
  * have no effect since a thread cannot be joined with itself.
+ * The same applies to sockets served by a reactor when called from one of the socket's own callbacks
+ * and to sockets using a workpool when called from tcp_data or tcp_disconnected.
  */
 void msocket_close(msocket_t *self){
    if (self !=0 ){
       uint8_t attempts;
+#ifndef _WIN32
+      if ( (self->workpool != 0) && (msocket_workpool_is_worker(self->workpool, self) != 0) ){
+#if MSOCKET_DEBUG
+         printf("[MSOCKET] Not allowed to call msocket_close from msocket worker thread\n");
+#endif
+         return;
+      }
+#endif
       for(attempts=0; attempts < MAX_CLOSE_ATTEMPTS; attempts++){
          uint8_t threadRunning;
          uint8_t socketMode;
@@ -168,20 +378,24 @@ void msocket_close(msocket_t *self){
             break; //already closed
          }
          if (threadRunning != 0) {
-#ifdef _WIN32
-            unsigned int currentThreadId = (unsigned int) GetCurrentThreadId();
-            if (currentThreadId == self->ioThreadId)
-#else
-            if(pthread_equal(pthread_self(),self->ioThread) != 0)
-#endif
+            if ( (msocket_isIoThread(self) != 0) || (msocket_joinIoThread(self) != 0) )
             {
 #if MSOCKET_DEBUG
                   printf("[MSOCKET] Not allowed to call msocket_close from msocket ioTask thread\n");
 #endif
                return;
             }
-            msocket_joinIoThread(self);
          }
+#ifndef _WIN32
+         if (self->workpool != 0){
+            msocket_workpool_cancel(self->workpool, self); //I/O driver has stopped, no new work can arrive
+         }
+#endif
+#ifdef __linux__
+         if ( (socketMode & MSOCKET_MODE_TCP) != 0){
+            msocket_zcFlush(self);
+         }
+#endif
          if (socketMode != MSOCKET_MODE_NONE){
             MUTEX_LOCK(self->mutex);
             msocket_closeInternalSocket(self, socketMode);
@@ -200,6 +414,26 @@ void msocket_close(msocket_t *self){
 
 
 
+/**
+ * Enables SO_REUSEPORT on sockets created by future calls to msocket_listen.
+ * This allows multiple sockets (typically one per thread) to listen on the same port, letting the kernel spread incoming connections between them.
+ */
+void msocket_set_reuse_port(msocket_t *self, uint8_t enable){
+   if(self != 0){
+      self->reusePort = enable;
+   }
+}
+
+/**
+ * Sets the length of the queue of pending connections for future calls to msocket_listen/msocket_unix_listen.
+ * backlog=0 restores the default (MSOCKET_DEFAULT_BACKLOG).
+ */
+void msocket_set_backlog(msocket_t *self, int backlog){
+   if(self != 0){
+      self->backlog = (backlog > 0)? backlog : MSOCKET_DEFAULT_BACKLOG;
+   }
+}
+
 int8_t msocket_listen(msocket_t *self,uint8_t mode, const uint16_t port, const char *addr){
    if(self != 0){
         int rc;
@@ -246,6 +480,11 @@ int8_t msocket_listen(msocket_t *self,uint8_t mode, const uint16_t port, const c
               return -1;
            }
            setsockopt(sockudp, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+#ifdef SO_REUSEPORT
+           if(self->reusePort != 0){
+              setsockopt(sockudp, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one));
+           }
+#endif
            if(self->addressFamily == AF_INET6){
               inet_pton(self->addressFamily, addr, &(mreq.ipv6mr_multiaddr));
               mreq.ipv6mr_interface = 0;
@@ -284,6 +523,11 @@ int8_t msocket_listen(msocket_t *self,uint8_t mode, const uint16_t port, const c
            sockoptval = 1;
            setsockopt(socktcp, SOL_SOCKET, SO_REUSEADDR, (const char*)&sockoptval, sockoptlen);
            setsockopt(socktcp, IPPROTO_TCP, TCP_NODELAY, (const char*)&sockoptval, sockoptlen);
+#ifdef SO_REUSEPORT
+           if(self->reusePort != 0){
+              setsockopt(socktcp, SOL_SOCKET, SO_REUSEPORT, (const char*)&sockoptval, sockoptlen);
+           }
+#endif
            if(self->addressFamily == AF_INET6){
               rc=bind(socktcp, (struct sockaddr *) &saddr6,sizeof(saddr6));
            }
@@ -294,7 +538,7 @@ int8_t msocket_listen(msocket_t *self,uint8_t mode, const uint16_t port, const c
               SOCKET_CLOSE(socktcp);
               return (int8_t) rc;
            }
-           rc = listen(socktcp,5);
+           rc = listen(socktcp, self->backlog);
            if(rc<0){
               SOCKET_CLOSE(socktcp);
               return (int8_t) rc;
@@ -341,7 +585,7 @@ int8_t msocket_unix_listen(msocket_t *self, const char *socket_path)
             SOCKET_CLOSE(sockunix);
             return rc;
          }
-         rc = listen(sockunix,5);
+         rc = listen(sockunix, self->backlog);
          if(rc<0){
             SOCKET_CLOSE(sockunix);
             return rc;
@@ -391,7 +635,9 @@ msocket_t *msocket_accept(msocket_t *self, msocket_t *child){
       }
 
       MUTEX_LOCK(self->mutex);
-      self->state = MSOCKET_STATE_LISTENING;
+      if (self->state == MSOCKET_STATE_ACCEPTING) {
+         self->state = MSOCKET_STATE_LISTENING; //unless msocket_close was called while waiting
+      }
       MUTEX_UNLOCK(self->mutex);
 
       if (result < 0) {
@@ -404,17 +650,7 @@ msocket_t *msocket_accept(msocket_t *self, msocket_t *child){
          return (msocket_t*)0;
       }
 
-      if ( (child->addressFamily == AF_INET) || (child->addressFamily == AF_INET6) ) {
-         int sockoptval = 1;
-         socklen_t sockoptlen = sizeof(sockoptval);
-         setsockopt(child->tcpsockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&sockoptval, sockoptlen);
-      }
-
-      MUTEX_LOCK(child->mutex);
-      child->state = MSOCKET_STATE_ESTABLISHED;
-      child->socketMode = MSOCKET_MODE_TCP;
-      child->newConnection = 1;
-      MUTEX_UNLOCK(child->mutex);
+      msocket_acceptComplete(child);
       return child;
    }
    return (msocket_t *) 0;
@@ -433,6 +669,191 @@ void msocket_set_handler(msocket_t *self, const msocket_handler_t *handlerTable,
    }
 }
 
+#ifdef __linux__
+/**
+ * Lets the reactor serve the socket I/O instead of a dedicated ioThread.
+ * Must be called before msocket_start_io, msocket_connect or msocket_listen (UDP).
+ */
+void msocket_set_reactor(msocket_t *self, struct msocket_reactor_tag *reactor){
+   if ( (self != 0) && (self->threadRunning == 0) ){
+      self->reactor = reactor;
+   }
+}
+#endif
+
+#ifndef _WIN32
+/**
+ * Hands tcp_data and tcp_disconnected callbacks of the socket to workers of workpool, leaving the I/O thread free to keep reading.
+ * Must be called before msocket_start_io, msocket_connect or msocket_unix_connect.
+ */
+void msocket_set_workpool(msocket_t *self, struct msocket_workpool_tag *workpool){
+   if ( (self != 0) && (self->threadRunning == 0) ){
+      self->workpool = workpool;
+   }
+}
+#endif
+
+/**
+ * Sets the bounds of the adaptive receive size (defaults MSOCKET_RX_SIZE_MIN and MSOCKET_RX_SIZE_MAX).
+ * The size requested from recv starts at minSize, doubles each time a receive fills it and is halved again after
+ * MSOCKET_RX_SHRINK_MS without a full receive, when unused receive buffer memory is also released.
+ */
+int8_t msocket_set_rx_size(msocket_t *self, uint32_t minSize, uint32_t maxSize){
+   if( (self != 0) && (minSize > 0u) && (minSize <= maxSize) ){
+      self->rxSizeMin = minSize;
+      self->rxSizeMax = maxSize;
+      self->rxSize = minSize;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Limits how many messages (tcp_message calls or frames passed to tcp_data_batch, or tcp_data calls without framing) the
+ * socket gets per wakeup of its I/O driver, so that one busy connection cannot hold up the others served by the same
+ * reactor. Messages left over stay in the receive buffer and are delivered, one budget at a time, before more is read
+ * from the socket. Bytes per wakeup are already bounded by the receive size, see msocket_set_rx_size.
+ * maxMessages=0 (default) removes the limit. Sockets using a workpool are not limited.
+ */
+void msocket_set_read_budget(msocket_t *self, uint32_t maxMessages){
+   if(self != 0){
+      self->rxBudget = maxMessages;
+   }
+}
+
+/**
+ * Limits how many received bytes may wait for the handler. With a workpool, reading pauses while the data handed to
+ * the workers is at the limit and resumes once they have worked it down to half. Otherwise only an incomplete message
+ * can make the receive buffer grow, the socket is closed (errno EMSGSIZE) when it reaches the limit.
+ * maxBuffered=0 (default) removes the limit.
+ */
+void msocket_set_rx_limit(msocket_t *self, uint32_t maxBuffered){
+   if(self != 0){
+      MUTEX_LOCK(self->mutex);
+      self->rxLimit = maxBuffered;
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+/**
+ * Stops reading from the socket until msocket_resume_read is called, the peer then gets flow controlled by TCP.
+ * Can be called from any thread. When called from tcp_data no more data is passed to the handler after the call returns.
+ * Messages already received may still be delivered until the end of the current read, return MSOCKET_RX_PAUSE
+ * from tcp_message or tcp_data_batch to stop right after a message.
+ */
+void msocket_pause_read(msocket_t *self){
+   if(self != 0){
+      MUTEX_LOCK(self->mutex);
+      self->rxPaused |= RX_PAUSE_USER;
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+/**
+ * Resumes reading after msocket_pause_read or MSOCKET_RX_PAUSE. Messages left in the receive buffer are delivered
+ * first, on the thread that normally runs the handler. Can be called from any thread, including from the handler.
+ */
+void msocket_resume_read(msocket_t *self){
+   if(self != 0){
+      uint8_t resumed;
+      MUTEX_LOCK(self->mutex);
+      resumed = ( (self->rxPaused & RX_PAUSE_USER) != 0u)? 1u : 0u;
+      self->rxPaused &= (uint8_t) ~RX_PAUSE_USER;
+#ifndef _WIN32
+      if( (resumed != 0u) && (self->workpool == 0) ){
+#else
+      if(resumed != 0u){
+#endif
+         self->rxResumed = 1u; //picked up by msocket_ioBacklog
+      }
+      MUTEX_UNLOCK(self->mutex);
+      if(resumed != 0u){
+#ifndef _WIN32
+         if(self->workpool != 0){
+            //tcpRxBuf belongs to the workers, one of them delivers what is left in it
+            (void) msocket_workpool_post(self->workpool, self, (const uint8_t*) 0, MSOCKET_WORK_RESUME);
+         }
+#endif
+         msocket_rxNotify(self);
+      }
+   }
+}
+
+/**
+ * Lets the socket split received data into length-prefixed messages and deliver each one to tcp_message (or all
+ * messages of a receive at once to tcp_data_batch) instead of passing raw data to tcp_data. Room for a partially received frame is reserved up front from its length header.
+ * config=NULL goes back to tcp_data. Must be called before msocket_start_io, msocket_connect or msocket_unix_connect.
+ */
+int8_t msocket_set_length_framing(msocket_t *self, const msocket_length_framing_t *config){
+   if(self != 0){
+      if(self->threadRunning != 0){
+         errno = EBUSY;
+         return -1;
+      }
+      return msocket_framer_set_length(&self->framer, config);
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Lets the socket split received data into records terminated by a delimiter byte (e.g. lines) and deliver each one,
+ * without the delimiter, to tcp_message or tcp_data_batch. Data that was already searched is not searched again when more arrives.
+ * config=NULL goes back to tcp_data. Must be called before msocket_start_io, msocket_connect or msocket_unix_connect.
+ */
+int8_t msocket_set_delimiter_framing(msocket_t *self, const msocket_delimiter_framing_t *config){
+   if(self != 0){
+      if(self->threadRunning != 0){
+         errno = EBUSY;
+         return -1;
+      }
+      return msocket_framer_set_delimiter(&self->framer, config);
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+#ifdef __linux__
+/**
+ * Replaces the growable receive buffer with a fixed size ring buffer (rounded up to page size) that is mapped twice back to back.
+ * tcp_data always sees received data as one contiguous block, even where it wraps around the end of the ring, and the
+ * memory used per connection stays fixed. A message larger than the ring closes the connection.
+ * size=0 goes back to the growable buffer. Must be called before msocket_start_io, msocket_connect or msocket_unix_connect.
+ */
+int8_t msocket_set_rx_ring(msocket_t *self, uint32_t size){
+   if(self != 0){
+      msocket_bytequeue_t rxBuf;
+      if( (self->threadRunning != 0) || (msocket_bytequeue_length(&self->tcpRxBuf) != 0u) ){
+         errno = EBUSY;
+         return -1;
+      }
+      if(size == 0u){
+         msocket_bytequeue_create(&rxBuf, 0u);
+      }
+      else{
+         msocket_adt_error_t rc = msocket_bytequeue_createRing(&rxBuf, size);
+         if(rc != ADT_NO_ERROR){
+            if(rc != ADT_MEM_ERROR){
+               errno = EINVAL;
+            }
+            return -1;
+         }
+      }
+      msocket_bytequeue_destroy(&self->tcpRxBuf);
+      self->tcpRxBuf = rxBuf;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+#endif
+
+/**
+ * Starts I/O on connected socket. It can also be used on a listening TCP socket,
+ * its tcp_accept callback is then triggered for each new connection (with srv set to NULL).
+ * The TCP socket is non-blocking from here on (not on Windows), all sending goes through msocket_send and friends.
+ */
 int8_t msocket_start_io(msocket_t *self){
    if(self != 0) {
       if (self->handlerTable == 0) {
@@ -457,7 +878,7 @@ int8_t msocket_connect(msocket_t *self, const char *addr, uint16_t port){
          errno = EFAULT;
          return -1;
       }
-      result = (self->addressFamily == AF_INET6) ? msocket_connect_inet6(self, addr, port) : msocket_connect_inet(self, addr, port);
+      result = (self->addressFamily == AF_INET6) ? msocket_connect_inet6(self, addr, port, 0u) : msocket_connect_inet(self, addr, port, 0u);
       if (result < 0) {
          return -1;
       }
@@ -477,6 +898,43 @@ int8_t msocket_connect(msocket_t *self, const char *addr, uint16_t port){
    return -1;
 }
 
+/**
+ * Starts connecting to addr:port and returns without waiting for the connection to be established.
+ * The I/O driver later triggers tcp_connected on success or tcp_connect_failed on failure.
+ * timeoutMs is the deadline for the connection to be established, 0 leaves it to the operating system.
+ * Returns -1 only when the connection attempt could not be started.
+ */
+int8_t msocket_connect_async(msocket_t *self, const char *addr, uint16_t port, uint32_t timeoutMs){
+   if( (self != 0) && (addr != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) == 0) ) {
+      int sockoptval = 1;
+      socklen_t sockoptlen = sizeof(sockoptval);
+      int result;
+      if (self->handlerTable == 0) {
+         errno = EFAULT;
+         return -1;
+      }
+      result = (self->addressFamily == AF_INET6) ? msocket_connect_inet6(self, addr, port, 1u) : msocket_connect_inet(self, addr, port, 1u);
+      if (result < 0) {
+         return -1;
+      }
+      setsockopt(self->tcpsockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&sockoptval, sockoptlen);
+      self->socketMode |= MSOCKET_MODE_TCP;
+      self->state = MSOCKET_STATE_PENDING;
+      self->connectTimeoutMs = timeoutMs;
+      result = msocket_startIoThread(self);
+      if (result < 0) {
+         SOCKET_CLOSE(self->tcpsockfd);
+         self->tcpsockfd = INVALID_SOCKET;
+         self->socketMode &= (uint8_t) (~MSOCKET_MODE_TCP);
+         self->state = MSOCKET_STATE_CLOSED;
+         return -1;
+      }
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
 
 int8_t msocket_unix_connect(msocket_t *self, const char *socketPath)
 {
@@ -519,23 +977,9 @@ int8_t msocket_unix_connect(msocket_t *self, const char *socketPath)
  */
 int8_t msocket_send_to(msocket_t *self, const char *addr,uint16_t port,const void *msgData,uint32_t msgLen){
    if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_UDP) != 0)){
-      struct sockaddr_in saddr;
-      struct sockaddr_in6 saddr6;
-      int rc;
-      if(self->addressFamily == AF_INET6){
-         memset(&saddr6, 0,sizeof(saddr6));
-         saddr6.sin6_family = AF_INET6;
-         saddr6.sin6_port = htons((uint16_t)port);
-         inet_pton(AF_INET6, addr, &(saddr6.sin6_addr));
-         rc = sendto(self->udpsockfd,msgData,msgLen,0,(struct sockaddr *)&saddr6,sizeof(saddr6));
-      }
-      else{
-         memset(&saddr, 0,sizeof(saddr));
-         saddr.sin_family = AF_INET;
-         saddr.sin_port = htons((uint16_t)port);
-         inet_pton(AF_INET, addr, &(saddr.sin_addr));
-         rc = sendto(self->udpsockfd,msgData,msgLen,0,(struct sockaddr *)&saddr,sizeof(saddr));
-      }
+      struct sockaddr_storage saddr;
+      SOCK_LEN_T saddrLen = msocket_udpAddress(self, addr, port, &saddr);
+      int rc = sendto(self->udpsockfd,msgData,msgLen,0,(struct sockaddr *)&saddr,saddrLen);
       if(rc < 0){
          return -1;
       }
@@ -549,13 +993,26 @@ int8_t msocket_send_to(msocket_t *self, const char *addr,uint16_t port,const voi
 }
 
 /**
- * Returns 0 on success, -1 on failure
+ * Returns 0 on success, -1 on failure.
+ * While the socket is served by an I/O driver the call never blocks: data that the socket cannot take right away
+ * is copied to the send queue and written by the I/O driver once the socket becomes writable (not on Windows).
+ * Producers should pause when msocket_send_queue_size goes above the high watermark and resume on tcp_writable.
  */
 int8_t msocket_send(msocket_t *self,const void *msgData,uint32_t msgLen){
    if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) ){
       assert(msgData != 0);
       const uint8_t *p = (const uint8_t*) msgData;
       uint32_t remain = msgLen;
+#ifndef _WIN32
+      if(self->threadRunning != 0){
+         struct iovec iov;
+         msocket_iovcursor_t cursor;
+         iov.iov_base = (void*) msgData;
+         iov.iov_len = msgLen;
+         (void) msocket_iovInit(&cursor, &iov, 1);
+         return msocket_sendQueued(self, &cursor, (msocket_buf_t*) 0, 0u, 0u);
+      }
+#endif
       while(remain>0){
          int n = send(self->tcpsockfd, (const char*) p, remain,0);
          if(n <= 0){
@@ -579,261 +1036,2380 @@ int8_t msocket_send(msocket_t *self,const void *msgData,uint32_t msgLen){
    return -1;
 }
 
-int8_t msocket_state(msocket_t *self){
-   if(self != 0){
-      uint8_t state;
+#ifndef _WIN32
+/**
+ * Scatter-gather version of msocket_send, e.g. for a header and a payload kept in different buffers.
+ * The fragments are written with as few sendmsg calls as possible, without first copying them into one buffer.
+ */
+int8_t msocket_sendv(msocket_t *self, const struct iovec *iov, int iovcnt){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) && (iov != 0) && (iovcnt >= 0) ){
+      msocket_iovcursor_t cursor;
+      if(msocket_iovInit(&cursor, iov, iovcnt) < 0){
+         errno = EMSGSIZE;
+         return -1;
+      }
+      if(self->threadRunning != 0){
+         return msocket_sendQueued(self, &cursor, (msocket_buf_t*) 0, 0u, 0u);
+      }
+      while(cursor.remain > 0u){
+         ssize_t n = msocket_iovSend(self->tcpsockfd, &cursor, 0);
+         if(n <= 0){
+            if( (n < 0) && (errno == EINTR) ){
+               continue;
+            }
+#if(MSOCKET_DEBUG)
+            perror("msocket: sendmsg failed: ");
+#endif
+            return -1;
+         }
+      }
       MUTEX_LOCK(self->mutex);
-      state = self->state;
+      msocket_timeoutReset(self);
       MUTEX_UNLOCK(self->mutex);
-      return state;
+      return 0;
    }
-   return 0;
+   errno = EINVAL;
+   return -1;
 }
 
-/***************** Private Function Definitions *******************/
-
-
-THREAD_PROTO(ioTask,arg){
-   if(arg!=0){
-      msocket_t *self = (msocket_t*)arg;
-      int rc;
-      fd_set readfds;
-      uint8_t *recvBuf;
-      struct timeval timeout;
-      uint8_t newConnection;
-# if(MSOCKET_DEBUG)
-   printf("[MSOCKET](0x%p)  ioTask starting\n",arg);
-#endif
-
-      timeout.tv_sec=0;
-      recvBuf = (uint8_t*) malloc(MSG_BUF_SIZE);
-      if(recvBuf == 0){
-         THREAD_RETURN(1);
+/**
+ * Scatter-gather version of msocket_send_to. All fragments are sent as one datagram.
+ */
+int8_t msocket_send_tov(msocket_t *self, const char *addr, uint16_t port, const struct iovec *iov, int iovcnt){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_UDP) != 0) && (iov != 0) && (iovcnt >= 0) ){
+      struct sockaddr_storage saddr;
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &saddr;
+      msg.msg_namelen = msocket_udpAddress(self, addr, port, &saddr);
+      msg.msg_iov = (struct iovec*) iov;
+      msg.msg_iovlen = iovcnt;
+      if(sendmsg(self->udpsockfd, &msg, 0) < 0){
+         return -1;
       }
-
-      //wait for parent thread to release lock before executing this thread
       MUTEX_LOCK(self->mutex);
-      newConnection = self->newConnection;
-      self->newConnection = 0;
+      msocket_timeoutReset(self);
       MUTEX_UNLOCK(self->mutex);
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+#endif
 
-      if (newConnection != 0) {
-         if (self->handlerTable->tcp_connected != 0) {
-            self->handlerTable->tcp_connected(self->handlerArg, &self->tcpInfo.addr[0], self->tcpInfo.port);
-         }
+#ifdef __linux__
+/**
+ * Enables MSG_ZEROCOPY for msocket_send_zerocopy calls of at least threshold bytes (see MSOCKET_ZEROCOPY_THRESHOLD).
+ * threshold=0 disables zero-copy. Call on an established TCP socket, fails when the kernel does not support SO_ZEROCOPY.
+ */
+int8_t msocket_set_zerocopy(msocket_t *self, uint32_t threshold){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) ){
+      int sockoptval = (threshold != 0u)? 1 : 0;
+      if( (self->addressFamily == AF_UNIX) && (threshold != 0u) ){
+         errno = EOPNOTSUPP;
+         return -1;
       }
+      if(setsockopt(self->tcpsockfd, SOL_SOCKET, SO_ZEROCOPY, (const char*)&sockoptval, sizeof(sockoptval)) < 0){
+         return -1;
+      }
+      MUTEX_LOCK(self->mutex);
+      self->zcThreshold = threshold;
+      MUTEX_UNLOCK(self->mutex);
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
 
-      while(1){
-         int max_sd = 0;
-         int activity;
-
-         FD_ZERO(&readfds);
-         if(self->socketMode & MSOCKET_MODE_UDP){
-            FD_SET(self->udpsockfd, &readfds);
-#ifndef _WIN32 //max_sd param is not used in WinSock2
-            if(self->udpsockfd > max_sd){
-               max_sd=self->udpsockfd;
-            }
+/**
+ * Same as msocket_send but lets the kernel send large buffers directly from msgData instead of copying them.
+ * Returns 1 when msgData is still referenced by the kernel: the buffer must be left untouched until tcp_send_complete
+ * is called with cookie. Returns 0 when the data was copied as usual (buffer below threshold, zero-copy not enabled or
+ * earlier data still queued), the buffer may then be reused right away. Returns -1 on failure, tcp_send_complete is
+ * still called with cookie when part of msgData had already been sent zero-copy.
+ * Zero-copy sends still pending when the socket is closed are completed by msocket_close (on the calling thread).
+ */
+int8_t msocket_send_zerocopy(msocket_t *self, const void *msgData, uint32_t msgLen, uint32_t cookie){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) && (msgData != 0) ){
+      uint32_t threshold;
+      MUTEX_LOCK(self->mutex);
+      threshold = self->zcThreshold;
+      MUTEX_UNLOCK(self->mutex);
+      if( (threshold != 0u) && (msgLen >= threshold) && (self->threadRunning != 0) ){
+         struct iovec iov;
+         msocket_iovcursor_t cursor;
+         iov.iov_base = (void*) msgData;
+         iov.iov_len = msgLen;
+         (void) msocket_iovInit(&cursor, &iov, 1);
+         return msocket_sendQueued(self, &cursor, (msocket_buf_t*) 0, 1u, cookie);
+      }
+      return msocket_send(self, msgData, msgLen);
+   }
+   errno = EINVAL;
+   return -1;
+}
 #endif
-         }
-         else if(self->socketMode & MSOCKET_MODE_TCP){ //the thread listening on UDP uses a different thread for TCP accept, use else-if here to prevent deadlock
-            FD_SET(self->tcpsockfd, &readfds);
-#ifndef _WIN32 //max_sd param is not used in WinSock2
-            if(self->tcpsockfd > max_sd){
-               max_sd=self->tcpsockfd;
-            }
+
+#ifdef __linux__
+/**
+ * Sends len bytes of file fd starting at offset, using sendfile so the data never passes through user space.
+ * When the socket is served by an I/O driver the call does not block: the part of the file the socket does not take
+ * right away is queued (as a reference to the file, not as data) and sent when the socket becomes writable.
+ * The file position of fd is not changed. fd is duplicated when needed, the caller may close it when the call returns.
+ * If the file turns out to be shorter than offset+len the connection is shut down.
+ * sendfile has no MSG_NOSIGNAL, applications using this function should ignore SIGPIPE.
+ */
+int8_t msocket_send_file(msocket_t *self, int fd, off_t offset, size_t len){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) && (fd >= 0) && (offset >= 0) && (len <= UINT32_MAX) ){
+      uint8_t notify = 0u;
+      uint8_t sent = 0u;
+      if(self->threadRunning == 0){
+         while(len > 0u){
+            ssize_t n = sendfile(self->tcpsockfd, fd, &offset, len);
+            if(n <= 0){
+               if( (n < 0) && (errno == EINTR) ){
+                  continue;
+               }
+               if(n == 0){
+                  errno = EIO; //file ended before len bytes were sent
+               }
+#if(MSOCKET_DEBUG)
+               perror("msocket: sendfile failed: ");
 #endif
+               return -1;
+            }
+            len -= (size_t) n;
          }
-         timeout.tv_usec=TIMEOUT_US;
-         activity = select( max_sd + 1 , &readfds , NULL , NULL , &timeout);
-         if(activity>0){
-            if( (self->socketMode & MSOCKET_MODE_UDP) && (FD_ISSET(self->udpsockfd,&readfds) != 0) ){
-               SOCK_LEN_T len;
-               //UDP activity
-               if(self->addressFamily == AF_INET6){
-                   struct sockaddr_in6 sock_addr6;
-                   len = (SOCK_LEN_T) sizeof(sock_addr6);
-                   memset(&sock_addr6, 0,sizeof(sock_addr6));
-                   rc = recvfrom(self->udpsockfd, (void*) recvBuf, MSG_BUF_SIZE, 0,(struct sockaddr *)&sock_addr6,&len);
-                   if(rc >= 0){
-                       self->udpInfo.port=ntohs(sock_addr6.sin6_port);
-                       inet_ntop(AF_INET6, &(sock_addr6.sin6_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
-                   }
+         MUTEX_LOCK(self->mutex);
+         msocket_timeoutReset(self);
+         MUTEX_UNLOCK(self->mutex);
+         return 0;
+      }
+      MUTEX_LOCK(self->mutex);
+      if( (self->state != MSOCKET_STATE_ESTABLISHED) && (self->state != MSOCKET_STATE_PENDING) ){
+         MUTEX_UNLOCK(self->mutex);
+         errno = ENOTCONN;
+         return -1;
+      }
+      if( (self->txHead == 0) && (self->txSending == 0u) && (self->state == MSOCKET_STATE_ESTABLISHED) ){
+         while(len > 0u){
+            ssize_t n = msocket_sendFileChunk(self->tcpsockfd, fd, &offset, len);
+            if(n < 0){
+               if(errno == EINTR){
+                  continue;
                }
-               else{
-                   struct sockaddr_in sock_addr4;
-                   len = (SOCK_LEN_T) sizeof(sock_addr4);
-                   memset(&sock_addr4, 0,sizeof(sock_addr4));
-                   rc = recvfrom(self->udpsockfd, (void*) recvBuf, MSG_BUF_SIZE, 0,(struct sockaddr *)&sock_addr4,&len);
-                   if(rc >= 0){
-                       self->udpInfo.port=ntohs(sock_addr4.sin_port);
-                       inet_ntop(AF_INET, &(sock_addr4.sin_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
-                   }
+               if( (errno == EAGAIN) || (errno == EWOULDBLOCK) ){
+                  break;
                }
-               if(rc>=0){
-                   rc = msocket_udpRxHandler(self, recvBuf, rc);
-                   if(rc < 0){
-                      break;
-                   }
+               if(sent != 0u){
+                  SOCKET_SHUTDOWN(self->tcpsockfd); //stream is incomplete
                }
+               MUTEX_UNLOCK(self->mutex);
+#if(MSOCKET_DEBUG)
+               perror("msocket: sendfile failed: ");
+#endif
+               return -1;
             }
-            if( (self->socketMode & MSOCKET_MODE_TCP) && (FD_ISSET(self->tcpsockfd,&readfds) != 0) ){
-               rc=recv(self->tcpsockfd, (char*) &recvBuf[0],MSG_BUF_SIZE,0);
-               rc = msocket_tcpRxHandler(self,recvBuf,rc);
-               if(rc < 0){
-                  break;
-               }
+            len -= (size_t) n;
+            sent = 1u;
+         }
+      }
+      if(len > 0u){
+         msocket_txitem_t *item;
+         if(self->txQueued > (UINT32_MAX - len)){
+            MUTEX_UNLOCK(self->mutex);
+            errno = EOVERFLOW;
+            return -1;
+         }
+         item = (msocket_txitem_t*) malloc(sizeof(msocket_txitem_t));
+         if(item != 0){
+            item->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if(item->fd < 0){
+               free(item);
+               item = (msocket_txitem_t*) 0;
+            }
+         }
+         if(item == 0){
+            if(sent != 0u){
+               SOCKET_SHUTDOWN(self->tcpsockfd); //stream is incomplete
             }
+            MUTEX_UNLOCK(self->mutex);
+            return -1;
+         }
+         item->next = (msocket_txitem_t*) 0;
+         item->len = (uint32_t) len;
+         item->offset = 0u;
+         item->buf = (msocket_buf_t*) 0;
+         item->fileOffset = offset;
+         if(self->txTail == 0){
+            self->txHead = item;
+            notify = 1u;
          }
          else{
-            uint8_t state;
-            MUTEX_LOCK(self->mutex);
-            state = self->state;
+            self->txTail->next = item;
+         }
+         self->txTail = item;
+         self->txQueued += (uint32_t) len;
+         if(self->txQueued > self->txHighWater){
+            self->txBlocked = 1u;
+         }
+      }
+      msocket_timeoutReset(self);
+      MUTEX_UNLOCK(self->mutex);
+      if(notify != 0u){
+         msocket_txNotify(self);
+      }
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+#endif
+
+/**
+ * Same as msocket_send for the data of a shared buffer. What the socket does not take right away is queued as a
+ * reference to buf, which is released once it has been sent. The caller keeps its own reference to buf.
+ */
+int8_t msocket_send_buf(msocket_t *self, msocket_buf_t *buf){
+   if( (self != 0) && ( (self->socketMode & MSOCKET_MODE_TCP) != 0) && (buf != 0) ){
+#ifndef _WIN32
+      if(self->threadRunning != 0){
+         struct iovec iov;
+         msocket_iovcursor_t cursor;
+         iov.iov_base = (void*) &buf->data[0];
+         iov.iov_len = buf->len;
+         (void) msocket_iovInit(&cursor, &iov, 1);
+         return msocket_sendQueued(self, &cursor, buf, 0u, 0u);
+      }
+#endif
+      return msocket_send(self, &buf->data[0], buf->len);
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Sets watermarks of the send queue. tcp_writable is triggered when the queue has been above highWater and drains to lowWater.
+ */
+void msocket_set_send_watermarks(msocket_t *self, uint32_t lowWater, uint32_t highWater){
+   if( (self != 0) && (lowWater <= highWater) ){
+      MUTEX_LOCK(self->mutex);
+      self->txLowWater = lowWater;
+      self->txHighWater = highWater;
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+/**
+ * Returns number of bytes waiting in the send queue
+ */
+uint32_t msocket_send_queue_size(msocket_t *self){
+   uint32_t retval = 0u;
+   if(self != 0){
+      MUTEX_LOCK(self->mutex);
+      retval = self->txQueued;
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return retval;
+}
+
+int8_t msocket_state(msocket_t *self){
+   if(self != 0){
+      uint8_t state;
+      MUTEX_LOCK(self->mutex);
+      state = self->state;
+      MUTEX_UNLOCK(self->mutex);
+      return state;
+   }
+   return 0;
+}
+
+/**
+ * Starts (or restarts) a timer that calls callback with the socket's handler argument after timeoutMs milliseconds.
+ * The callback runs on the thread serving the socket's I/O, the socket must therefore have been started (from tcp_connected onwards).
+ * All timers of a socket are cancelled when the socket is closed. Timer memory is owned by the caller.
+ * Returns 0 on success, -1 on failure.
+ */
+int8_t msocket_timer_start(msocket_t *self, msocket_timer_t *timer, uint32_t timeoutMs, msocket_timer_cb_t *callback){
+   if( (self != 0) && (timer != 0) && (callback != 0) ){
+      int8_t result = -1;
+      if(timeoutMs > (uint32_t) INT32_MAX){
+         timeoutMs = (uint32_t) INT32_MAX;
+      }
+      msocket_timerLock(self);
+      if(self->timerWheel != 0){
+         timer->callback = callback;
+         timer->owner = (void*) self;
+         msocket_timerwheel_add(self->timerWheel, timer, msocket_timestamp() + timeoutMs, &self->timers);
+         result = 0;
+      }
+      msocket_timerUnlock(self);
+      if(result != 0){
+         errno = ENOTCONN;
+         return -1;
+      }
+      msocket_timerNotify(self);
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Stops timer if it is running. A callback that is already executing on another thread is not waited for.
+ */
+void msocket_timer_cancel(msocket_t *self, msocket_timer_t *timer){
+   if( (self != 0) && (timer != 0) ){
+      msocket_timerLock(self);
+      if( (self->timerWheel != 0) && (timer->owner == (void*) self) ){
+         msocket_timerwheel_remove(self->timerWheel, timer);
+      }
+      msocket_timerUnlock(self);
+   }
+}
+
+/**
+ * Creates shared buffer holding a copy of data, with a reference count of 1
+ */
+msocket_buf_t *msocket_buf_new(const void *data, uint32_t len){
+   msocket_buf_t *self = (msocket_buf_t*) malloc(sizeof(msocket_buf_t) + len);
+   if(self != 0){
+      self->refCount = 1u;
+      self->len = len;
+      self->data = (uint8_t*) (self + 1);
+      self->block = (msocket_rxblock_t*) 0;
+      if( (data != 0) && (len > 0u) ){
+         memcpy(&self->data[0], data, len);
+      }
+   }
+   return self;
+}
+
+msocket_buf_t *msocket_buf_ref(msocket_buf_t *self){
+   if(self != 0){
+      (void) ATOMIC_INC(self->refCount);
+   }
+   return self;
+}
+
+void msocket_buf_unref(msocket_buf_t *self){
+   if( (self != 0) && (ATOMIC_DEC(self->refCount) == 0u) ){
+      if(self->block != 0){
+         msocket_rxblockUnref(self->block);
+      }
+      free(self);
+   }
+}
+
+/**
+ * Keeps received data beyond the tcp_data, tcp_message or tcp_data_batch callback it was passed to, without copying it.
+ * Must be called from within that callback with data (or part of it) as argument. The socket hands the receive buffer
+ * holding the data over to the returned msocket_buf_t and continues in a fresh buffer, taken from a pool when one is free.
+ * Data that is not held by the receive buffer (fixed size ring buffer, data parsed in place) is copied.
+ * Returns NULL when out of memory. Release the buffer with msocket_buf_unref.
+ */
+msocket_buf_t *msocket_rx_retain(msocket_t *self, const uint8_t *data, uint32_t len){
+   if( (self != 0) && ( (data != 0) || (len == 0u) ) ){
+      msocket_buf_t *buf;
+      const msocket_bytequeue_t *rxBuf = &self->tcpRxBuf;
+      if( (rxBuf->isRing) || (rxBuf->pData == 0) || (data < rxBuf->pData) || (len > rxBuf->u32AllocLen) ||
+          (data > rxBuf->pData + (rxBuf->u32AllocLen - len)) ){
+         buf = msocket_buf_new(data, len);
+      }
+      else{
+         buf = (msocket_buf_t*) malloc(sizeof(msocket_buf_t));
+         if( (buf != 0) && (self->rxBlock == 0) ){
+            self->rxBlock = (msocket_rxblock_t*) malloc(sizeof(msocket_rxblock_t));
+            if(self->rxBlock == 0){
+               free(buf);
+               buf = (msocket_buf_t*) 0;
+            }
+            else{
+               self->rxBlock->refCount = 1u; //released by msocket_rxRenew when the callback returns
+               self->rxBlock->next = (msocket_rxblock_t*) 0;
+               self->rxBlock->data = rxBuf->pData;
+               self->rxBlock->size = rxBuf->u32AllocLen;
+            }
+         }
+         if(buf != 0){
+            buf->refCount = 1u;
+            buf->len = len;
+            buf->data = (uint8_t*) data;
+            buf->block = self->rxBlock;
+            (void) ATOMIC_INC(self->rxBlock->refCount);
+         }
+      }
+      if(buf == 0){
+         errno = ENOMEM;
+      }
+      return buf;
+   }
+   errno = EINVAL;
+   return (msocket_buf_t*) 0;
+}
+
+void msocket_group_create(msocket_group_t *self){
+   if(self != 0){
+      MUTEX_INIT(self->mutex);
+      self->head = (msocket_t*) 0;
+      self->numSockets = 0u;
+   }
+}
+
+/**
+ * Removes all sockets from the group. The sockets themselves are not closed.
+ */
+void msocket_group_destroy(msocket_group_t *self){
+   if(self != 0){
+      MUTEX_LOCK(self->mutex);
+      while(self->head != 0){
+         msocket_t *msocket = self->head;
+         self->head = msocket->groupNext;
+         msocket->group = (msocket_group_t*) 0;
+         msocket->groupNext = (msocket_t*) 0;
+         msocket->groupPrev = (msocket_t*) 0;
+      }
+      self->numSockets = 0u;
+      MUTEX_UNLOCK(self->mutex);
+      MUTEX_DESTROY(self->mutex);
+   }
+}
+
+/**
+ * Adds msocket to the group. A socket can be member of one group at a time.
+ */
+void msocket_group_add(msocket_group_t *self, msocket_t *msocket){
+   if( (self != 0) && (msocket != 0) ){
+      msocket_group_remove(msocket);
+      MUTEX_LOCK(self->mutex);
+      msocket->group = self;
+      msocket->groupPrev = (msocket_t*) 0;
+      msocket->groupNext = self->head;
+      if(self->head != 0){
+         self->head->groupPrev = msocket;
+      }
+      self->head = msocket;
+      self->numSockets++;
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+void msocket_group_remove(msocket_t *msocket){
+   if( (msocket != 0) && (msocket->group != 0) ){
+      msocket_group_t *self = msocket->group;
+      MUTEX_LOCK(self->mutex);
+      if(msocket->group == self){
+         if(msocket->groupPrev != 0){
+            msocket->groupPrev->groupNext = msocket->groupNext;
+         }
+         else{
+            self->head = msocket->groupNext;
+         }
+         if(msocket->groupNext != 0){
+            msocket->groupNext->groupPrev = msocket->groupPrev;
+         }
+         msocket->group = (msocket_group_t*) 0;
+         msocket->groupNext = (msocket_t*) 0;
+         msocket->groupPrev = (msocket_t*) 0;
+         self->numSockets--;
+      }
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+uint32_t msocket_group_num_sockets(msocket_group_t *self){
+   uint32_t retval = 0u;
+   if(self != 0){
+      MUTEX_LOCK(self->mutex);
+      retval = self->numSockets;
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return retval;
+}
+
+/**
+ * Sends buf to every established socket in the group (see msocket_send_buf), returns number of sockets it was sent
+ * or queued to. Sockets that are not served by an I/O driver are skipped, their blocking send would stall the group
+ * (and every msocket_group_add/remove) while the group mutex is held.
+ */
+uint32_t msocket_group_send_buf(msocket_group_t *self, msocket_buf_t *buf){
+   uint32_t retval = 0u;
+   if( (self != 0) && (buf != 0) ){
+      msocket_t *msocket;
+      MUTEX_LOCK(self->mutex);
+      for(msocket = self->head; msocket != 0; msocket = msocket->groupNext){
+         if( (msocket_isServedEstablished(msocket) != 0u) && (msocket_send_buf(msocket, buf) >= 0) ){
+            retval++;
+         }
+      }
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return retval;
+}
+
+/***************** Private Function Definitions *******************/
+
+
+THREAD_PROTO(ioTask,arg){
+   if(arg!=0){
+      msocket_t *self = (msocket_t*)arg;
+      uint8_t *recvBuf;
+      msocket_timerwheel_t timers;
+# if(MSOCKET_DEBUG)
+   printf("[MSOCKET](0x%p)  ioTask starting\n",arg);
+#endif
+
+      recvBuf = (uint8_t*) malloc(MSG_BUF_SIZE);
+      if(recvBuf == 0){
+         THREAD_RETURN(1);
+      }
+      msocket_timerwheel_create(&timers, msocket_timestamp());
+      MUTEX_LOCK(self->mutex);
+      msocket_ioTimersStart(self, &timers);
+      MUTEX_UNLOCK(self->mutex);
+
+      msocket_ioConnected(self);
+
+      while(1){
+         int activity;
+         SOCKET_T sockfd;
+         uint8_t state;
+         uint8_t readPaused;
+         uint8_t resumed;
+         uint32_t delayMs;
+         uint32_t now = msocket_timestamp();
+         msocket_timer_t *timer;
+#ifndef _WIN32
+         uint8_t sendPending;
+         short revents = 0;
+#endif
+         //the thread listening on UDP uses a different thread for TCP accept, prefer UDP here to prevent deadlock
+         sockfd = (self->socketMode & MSOCKET_MODE_UDP)? self->udpsockfd : self->tcpsockfd;
+         MUTEX_LOCK(self->mutex);
+         state = self->state;
+         timer = (state == MSOCKET_STATE_CLOSING)? (msocket_timer_t*) 0 : msocket_timerwheel_expire(&timers, now);
+         if(timer != 0){
+            msocket_timer_cb_t *callback = timer->callback;
             MUTEX_UNLOCK(self->mutex);
-            if(state == MSOCKET_STATE_CLOSING){
+            (void) msocket_ioTimer(self, timer, callback);
+            continue;
+         }
+         delayMs = msocket_timerwheel_next(&timers, now);
+         readPaused = (self->rxPaused != 0u)? 1u : 0u;
+         resumed = self->rxResumed;
+#ifndef _WIN32
+         sendPending = (self->txHead != 0)? 1u : 0u;
+#endif
+         MUTEX_UNLOCK(self->mutex);
+         if(state == MSOCKET_STATE_CLOSING){
+            break;
+         }
+         if( (resumed != 0u) || (msocket_ioBacklogPending(self) != 0u) ){
+            if(msocket_ioBacklog(self) < 0){
                break;
             }
-            else if(state == MSOCKET_STATE_ESTABLISHED){
-               uint8_t inactivity_timeout = 0;
-               MUTEX_LOCK(self->mutex);
-               inactivity_timeout = msocket_timeoutIncrease(self);
-               MUTEX_UNLOCK(self->mutex);
-               if( (inactivity_timeout != 0) && (self->handlerTable->tcp_inactivity != 0)){
-                  self->handlerTable->tcp_inactivity(self->inactivityMs);
+            if(msocket_ioBacklogPending(self) != 0u){
+               delayMs = 0u; //only check for other events before the next budget
+            }
+         }
+#ifdef _WIN32
+         {
+            fd_set readfds;
+            fd_set writefds;
+            fd_set exceptfds;
+            struct timeval timeout;
+            if(delayMs > TIMEOUT_MS){
+               delayMs = TIMEOUT_MS; //no way to wake up select from msocket_close, poll for state changes
+            }
+            FD_ZERO(&readfds);
+            FD_ZERO(&writefds);
+            FD_ZERO(&exceptfds);
+            if(state == MSOCKET_STATE_PENDING){
+               FD_SET(sockfd, &writefds); //connect succeeded
+               FD_SET(sockfd, &exceptfds); //connect failed
+            }
+            else if(readPaused == 0u){
+               FD_SET(sockfd, &readfds);
+            }
+            timeout.tv_sec = 0;
+            timeout.tv_usec = (long) delayMs * 1000;
+            if( (state != MSOCKET_STATE_PENDING) && (readPaused != 0u) ){
+               Sleep(delayMs); //select fails when no socket is given
+               activity = 0;
+            }
+            else{
+               activity = select(0, &readfds, &writefds, &exceptfds, &timeout);
+            }
+         }
+#else
+         {
+            struct pollfd fds[2];
+            fds[0].fd = sockfd;
+            if(state == MSOCKET_STATE_PENDING){
+               fds[0].events = POLLOUT; //writable once connect completes
+            }
+            else{
+               fds[0].events = (readPaused != 0u)? 0 : POLLIN;
+               if(sendPending != 0u){
+                  fds[0].events |= POLLOUT;
                }
+               else if(readPaused != 0u){
+                  fds[0].fd = -1; //ignored by poll, POLLHUP would otherwise be reported over and over
+               }
+            }
+            fds[0].revents = 0;
+            fds[1].fd = self->wakeupfd[0];
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            activity = poll(&fds[0], 2, (delayMs > (uint32_t) INT32_MAX)? -1 : (int) delayMs);
+            if( (activity < 0) && (errno == EINTR) ){
+               continue;
             }
+            if( (activity > 0) && (fds[1].revents != 0) ){
+               msocket_wakeupDrain(self);
+               activity = (fds[0].revents != 0)? 1 : 0;
+            }
+            revents = fds[0].revents;
          }
+#endif
+         if(activity>0){
+#ifndef _WIN32
+            if(state != MSOCKET_STATE_PENDING){
+#ifdef __linux__
+               if( (revents & POLLERR) != 0){
+                  int count = msocket_ioErrQueue(self);
+                  if(count < 0){
+                     break;
+                  }
+                  if(count > 0){
+                     revents &= ~POLLERR; //zero-copy completions, not a socket error
+                  }
+               }
+#endif
+               if( ( (revents & POLLOUT) != 0) && (msocket_ioWritable(self) < 0) ){
+                  break;
+               }
+               if( (revents & ~POLLOUT) == 0){
+                  continue; //only writable
+               }
+            }
+#endif
+            if(msocket_ioReadable(self, recvBuf, MSG_BUF_SIZE) < 0){
+               break;
+            }
+         }
+         else if(activity < 0){
+#if(MSOCKET_DEBUG)
+            perror("msocket: poll failed: ");
+#endif
+            break;
+         }
+      }
+      MUTEX_LOCK(self->mutex);
+      msocket_ioTimersStop(self);
+      MUTEX_UNLOCK(self->mutex);
+      free(recvBuf);
+   }
+# if(MSOCKET_DEBUG)
+   printf("[MSOCKET](0x%p) ioTask exiting\n",arg);
+#endif
+   THREAD_RETURN(0);
+}
+
+/**
+ * Triggers the tcp_connected callback for newly established connections. Called once by the I/O driver before it starts waiting for events.
+ */
+int msocket_ioConnected(msocket_t *self){
+   uint8_t newConnection;
+   uint8_t state;
+   //wait for parent thread to release lock before executing this thread
+   MUTEX_LOCK(self->mutex);
+   newConnection = self->newConnection;
+   self->newConnection = 0;
+   MUTEX_UNLOCK(self->mutex);
+
+   if (newConnection != 0) {
+      if (self->handlerTable->tcp_connected != 0) {
+         self->handlerTable->tcp_connected(self->handlerArg, &self->tcpInfo.addr[0], self->tcpInfo.port);
+      }
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : 0;
+}
+
+/**
+ * Receives and processes data on the socket. Called by the I/O driver when the socket is readable.
+ */
+int msocket_ioReadable(msocket_t *self, uint8_t *recvBuf, uint32_t bufSize){
+   int rc;
+   if(self->socketMode & MSOCKET_MODE_UDP){
+#ifdef __linux__
+      (void) recvBuf;
+      (void) bufSize;
+      return msocket_udpReceiveBatch(self);
+#else
+      SOCK_LEN_T len;
+      //UDP activity
+      if(self->addressFamily == AF_INET6){
+          struct sockaddr_in6 sock_addr6;
+          len = (SOCK_LEN_T) sizeof(sock_addr6);
+          memset(&sock_addr6, 0,sizeof(sock_addr6));
+          rc = recvfrom(self->udpsockfd, (void*) recvBuf, bufSize, 0,(struct sockaddr *)&sock_addr6,&len);
+          if(rc >= 0){
+              self->udpInfo.port=ntohs(sock_addr6.sin6_port);
+              inet_ntop(AF_INET6, &(sock_addr6.sin6_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
+          }
+      }
+      else{
+          struct sockaddr_in sock_addr4;
+          len = (SOCK_LEN_T) sizeof(sock_addr4);
+          memset(&sock_addr4, 0,sizeof(sock_addr4));
+          rc = recvfrom(self->udpsockfd, (void*) recvBuf, bufSize, 0,(struct sockaddr *)&sock_addr4,&len);
+          if(rc >= 0){
+              self->udpInfo.port=ntohs(sock_addr4.sin_port);
+              inet_ntop(AF_INET, &(sock_addr4.sin_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
+          }
+      }
+      if(rc>=0){
+          rc = msocket_udpRxHandler(self, recvBuf, rc);
+          if(rc < 0){
+             return -1;
+          }
+      }
+#endif
+   }
+   else if(self->socketMode & MSOCKET_MODE_TCP){
+      uint8_t state;
+      uint8_t readPaused;
+      MUTEX_LOCK(self->mutex);
+      state = self->state;
+      readPaused = self->rxPaused;
+      MUTEX_UNLOCK(self->mutex);
+      if(state == MSOCKET_STATE_LISTENING){
+         rc = msocket_acceptHandler(self);
+      }
+      else if(state == MSOCKET_STATE_PENDING){
+         return msocket_connectComplete(self);
+      }
+      else if(self->rxBacklog != 0u){
+         return 0; //messages left by the read budget are delivered first, see msocket_ioBacklog
+      }
+      else if(readPaused != 0u){
+         return 0; //msocket_resume_read lets the driver know
+      }
+      else{
+         return msocket_tcpReceive(self, recvBuf, bufSize);
+      }
+      if(rc < 0){
+         return -1;
+      }
+      MUTEX_LOCK(self->mutex);
+      state = self->state;
+      MUTEX_UNLOCK(self->mutex);
+      if(state == MSOCKET_STATE_CLOSING){
+         return -1; //msocket_close was called on the listening socket
+      }
+   }
+   return 0;
+}
+
+/**
+ * Processes the result of a TCP receive operation that was carried out by the I/O driver.
+ * len has the same meaning as the return value of recv (on failure errno must be set).
+ * recvBuf=0 means the data was received directly into the tail of tcpRxBuf.
+ */
+int msocket_ioReceived(msocket_t *self, uint8_t *recvBuf, int len){
+   uint8_t state;
+   if(msocket_tcpRxHandler(self, recvBuf, len) < 0){
+      return -1;
+   }
+   MUTEX_LOCK(self->mutex);
+   if(len > 0){
+      msocket_timeoutReset(self);
+   }
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   if(state == MSOCKET_STATE_CLOSING){
+      return -1; //handler or msocket_close requested the socket to be closed
+   }
+   return 0;
+}
+
+/**
+ * Returns the number of bytes the I/O driver should request when it receives into a buffer of its own.
+ */
+uint32_t msocket_ioRecvSize(msocket_t *self){
+   uint32_t recvSize = self->rxSize;
+   if(self->tcpRxBuf.isRing){
+      uint32_t tailLen = msocket_bytequeue_tailLength(&self->tcpRxBuf);
+      if( (tailLen > 0u) && (tailLen < recvSize) ){
+         recvSize = tailLen; //what the read budget or a paused read holds back has to fit into the ring
+      }
+   }
+   return recvSize;
+}
+
+/**
+ * Tells the socket that a receive carried out by the I/O driver filled the requested size.
+ */
+void msocket_ioRecvFull(msocket_t *self){
+   msocket_rxGrow(self);
+}
+
+/**
+ * Delivers up to one more read budget of the messages that were left in tcpRxBuf. Called by the I/O driver, in turn
+ * with its other sockets, while msocket_ioBacklogPending returns 1 and once after reading was resumed.
+ */
+int msocket_ioBacklog(msocket_t *self){
+   MUTEX_LOCK(self->mutex);
+   self->rxResumed = 0u;
+   MUTEX_UNLOCK(self->mutex);
+#ifndef _WIN32
+   if(self->workpool != 0){
+      return 0; //tcpRxBuf belongs to the workers
+   }
+#endif
+   self->rxBudgetLeft = (self->rxBudget != 0u)? self->rxBudget : UINT32_MAX;
+   return msocket_tcpParseQueue(self);
+}
+
+uint8_t msocket_ioBacklogPending(msocket_t *self){
+   return self->rxBacklog;
+}
+
+/**
+ * Returns 1 while the I/O driver must not receive from the socket, see msocket_pause_read and msocket_set_rx_limit
+ */
+uint8_t msocket_ioReadPaused(msocket_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = (self->rxPaused != 0u)? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+
+#ifndef _WIN32
+/**
+ * Sends as much of the send queue as the socket takes without blocking. Called by the I/O driver when the socket is writable.
+ * Returns 1 when data remains in the queue, 0 when the queue is empty and -1 when the driver should stop serving the socket.
+ */
+int msocket_ioWritable(msocket_t *self){
+   uint8_t writable = 0u;
+   uint8_t state;
+   int retval;
+   MUTEX_LOCK(self->mutex);
+   while(self->txHead != 0){
+      msocket_txitem_t *item = self->txHead;
+      const uint8_t *data = (item->buf != 0)? &item->buf->data[0] : &item->data[0];
+      ssize_t n;
+#ifdef __linux__
+      if(item->fd >= 0){
+         n = msocket_sendFileChunk(self->tcpsockfd, item->fd, &item->fileOffset, item->len - item->offset);
+      }
+      else
+#endif
+      n = send(self->tcpsockfd, (const char*) &data[item->offset], item->len - item->offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if(n < 0){
+         if(errno == EINTR){
+            continue;
+         }
+         if( (errno != EAGAIN) && (errno != EWOULDBLOCK) ){
+#if(MSOCKET_DEBUG)
+            perror("msocket: send failed: ");
+#endif
+            msocket_txClear(self);
+            SOCKET_SHUTDOWN(self->tcpsockfd); //stream is incomplete, receive side reports the disconnect
+         }
+         break;
+      }
+      item->offset += (uint32_t) n;
+      self->txQueued -= (uint32_t) n;
+      if(item->offset == item->len){
+         self->txHead = item->next;
+         if(self->txHead == 0){
+            self->txTail = (msocket_txitem_t*) 0;
+         }
+         msocket_txFree(item);
+      }
+   }
+   if( (self->txBlocked != 0u) && (self->txQueued <= self->txLowWater) ){
+      self->txBlocked = 0u;
+      writable = 1u;
+   }
+   retval = (self->txHead != 0)? 1 : 0;
+   MUTEX_UNLOCK(self->mutex);
+   if( (writable != 0u) && (self->handlerTable->tcp_writable != 0) ){
+      self->handlerTable->tcp_writable(self->handlerArg);
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : retval;
+}
+
+uint8_t msocket_ioSendPending(msocket_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = (self->txHead != 0)? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Reads MSG_ZEROCOPY completions from the socket error queue and triggers tcp_send_complete for finished sends.
+ * Called by the I/O driver on POLLERR. Returns number of completions read (0 means POLLERR has another cause)
+ * or -1 when the driver should stop serving the socket.
+ * The queue is always drained so POLLERR does not fire again, completions that no send is waiting for are dropped.
+ */
+int msocket_ioErrQueue(msocket_t *self){
+   msocket_zcitem_t *done = (msocket_zcitem_t*) 0;
+   int count = 0;
+   uint8_t state;
+   MUTEX_LOCK(self->mutex);
+   while(1){
+      union{
+         struct cmsghdr align;
+         uint8_t buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+      }control;
+      struct msghdr msg;
+      struct cmsghdr *cmsg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control.buf;
+      msg.msg_controllen = sizeof(control.buf);
+      if(recvmsg(self->tcpsockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0){
+         if(errno == EINTR){
+            continue;
+         }
+         break;
+      }
+      for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+         const struct sock_extended_err *serr = (const struct sock_extended_err*) CMSG_DATA(cmsg);
+         if( ( ( (cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR) ) ||
+               ( (cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR) ) ) &&
+             (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) ){
+            //sends ee_info..ee_data completed, completions arrive in order for TCP
+            while( (self->zcHead != 0) && ( (int32_t) (self->zcHead->lastId - serr->ee_data) <= 0) ){
+               msocket_zcitem_t *item = self->zcHead;
+               self->zcHead = item->next;
+               item->next = done;
+               done = item;
+            }
+            count++;
+         }
+      }
+   }
+   if(self->zcHead == 0){
+      self->zcTail = (msocket_zcitem_t*) 0;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if(done != 0){
+      msocket_zcitem_t *item = (msocket_zcitem_t*) 0;
+      while(done != 0){ //reverse to completion order
+         msocket_zcitem_t *next = done->next;
+         done->next = item;
+         item = done;
+         done = next;
+      }
+      msocket_zcComplete(self, item);
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : count;
+}
+
+uint8_t msocket_ioZerocopyPending(msocket_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = (self->zcHead != 0)? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+
+/**
+ * Takes up to maxIov items from the head of the send queue for a send that the I/O driver submits to io_uring and
+ * describes their unsent data in iov. The items stay allocated until the driver passes them to msocket_ioSendComplete,
+ * or to msocket_ioSendRelease when the socket was detached in the meantime. Stops at the first file item, files are
+ * sent by msocket_ioWritable. Returns NULL when there is nothing to take.
+ */
+struct msocket_txitem_tag *msocket_ioSendBegin(msocket_t *self, struct iovec *iov, int maxIov, int *iovcnt){
+   msocket_txitem_t *items = (msocket_txitem_t*) 0;
+   int count = 0;
+   MUTEX_LOCK(self->mutex);
+   if(self->txSending == 0u){
+      msocket_txitem_t *last = (msocket_txitem_t*) 0;
+      while( (self->txHead != 0) && (count < maxIov) && (self->txHead->fd < 0) ){
+         msocket_txitem_t *item = self->txHead;
+         uint8_t *data = (item->buf != 0)? &item->buf->data[0] : &item->data[0];
+         iov[count].iov_base = &data[item->offset];
+         iov[count].iov_len = item->len - item->offset;
+         count++;
+         if(last == 0){
+            items = item;
+         }
+         last = item;
+         self->txHead = item->next;
+      }
+      if(last != 0){
+         last->next = (msocket_txitem_t*) 0;
+         if(self->txHead == 0){
+            self->txTail = (msocket_txitem_t*) 0;
+         }
+         self->txSending = 1u;
+      }
+   }
+   MUTEX_UNLOCK(self->mutex);
+   *iovcnt = count;
+   return items;
+}
+
+/**
+ * Finishes a send started by msocket_ioSendBegin, result is the number of bytes sent or a negative errno value.
+ * Sent items are freed and the rest goes back to the head of the send queue. Returns like msocket_ioWritable.
+ */
+int msocket_ioSendComplete(msocket_t *self, struct msocket_txitem_tag *items, int result){
+   uint32_t sent = (result > 0)? (uint32_t) result : 0u;
+   uint8_t writable = 0u;
+   uint8_t state;
+   int retval;
+   MUTEX_LOCK(self->mutex);
+   self->txSending = 0u;
+   self->txQueued -= sent;
+   while( (items != 0) && (sent >= items->len - items->offset) ){
+      msocket_txitem_t *item = items;
+      sent -= item->len - item->offset;
+      items = item->next;
+      msocket_txFree(item);
+   }
+   if(items != 0){
+      msocket_txitem_t *last = items;
+      items->offset += sent;
+      while(last->next != 0){
+         last = last->next;
+      }
+      last->next = self->txHead;
+      if(self->txHead == 0){
+         self->txTail = last;
+      }
+      self->txHead = items;
+   }
+   if( (result < 0) && (result != -EAGAIN) && (result != -EINTR) && (result != -ECANCELED) ){
+#if(MSOCKET_DEBUG)
+      fprintf(stderr, "[MSOCKET] send failed: %d\n", result);
+#endif
+      msocket_txClear(self);
+      SOCKET_SHUTDOWN(self->tcpsockfd); //stream is incomplete, receive side reports the disconnect
+   }
+   if( (self->txBlocked != 0u) && (self->txQueued <= self->txLowWater) ){
+      self->txBlocked = 0u;
+      writable = 1u;
+   }
+   retval = (self->txHead != 0)? 1 : 0;
+   MUTEX_UNLOCK(self->mutex);
+   if( (writable != 0u) && (self->handlerTable->tcp_writable != 0) ){
+      self->handlerTable->tcp_writable(self->handlerArg);
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : retval;
+}
+
+/**
+ * Frees items of a send that completed after its socket was detached from the I/O driver
+ */
+void msocket_ioSendRelease(struct msocket_txitem_tag *items){
+   while(items != 0){
+      msocket_txitem_t *item = items;
+      items = item->next;
+      msocket_txFree(item);
+   }
+}
+#endif
+
+/**
+ * Processes a connection that was accepted by the I/O driver on behalf of the listening socket self.
+ */
+int msocket_ioAccepted(msocket_t *self, SOCKET_T sockfd, const struct sockaddr *addr){
+   msocket_t *child = msocket_new(self->addressFamily);
+   if (child == 0){
+      SOCKET_CLOSE(sockfd);
+      return 0;
+   }
+   if (msocket_setPeerAddress(child, addr) < 0){
+      SOCKET_CLOSE(sockfd);
+      msocket_delete(child);
+      return 0;
+   }
+   child->tcpsockfd = sockfd;
+   msocket_acceptComplete(child);
+   if (self->handlerTable->tcp_accept != 0){
+      self->handlerTable->tcp_accept(self->handlerArg, (struct msocket_server_tag*) 0, child);
+   }
+   else{
+      msocket_delete(child);
+   }
+   return 0;
+}
+
+/**
+ * Connects the socket to the timer wheel of the I/O driver that starts serving it. Caller must hold the driver's timer lock.
+ */
+void msocket_ioTimersStart(msocket_t *self, msocket_timerwheel_t *wheel){
+   self->timerWheel = wheel;
+   if(self->state == MSOCKET_STATE_PENDING){
+      if(self->connectTimeoutMs != 0u){
+         msocket_timerwheel_add(wheel, &self->connectTimer, msocket_timestamp() + self->connectTimeoutMs, &self->timers);
+      }
+   }
+   else{
+      msocket_inactivityStart(self);
+   }
+}
+
+/**
+ * Cancels all timers of the socket. Caller must hold the driver's timer lock.
+ */
+void msocket_ioTimersStop(msocket_t *self){
+   if(self->timerWheel != 0){
+      msocket_timerwheel_remove_all(self->timerWheel, &self->timers);
+      self->timerWheel = (msocket_timerwheel_t*) 0;
+   }
+}
+
+/**
+ * Runs an expired timer of the socket. callback is the value of timer->callback at the time it expired.
+ */
+int msocket_ioTimer(msocket_t *self, msocket_timer_t *timer, msocket_timer_cb_t *callback){
+   uint8_t state;
+   if(timer == &self->inactivityTimer){
+      msocket_inactivityTimeout(self);
+   }
+   else if(timer == &self->connectTimer){
+      (void) msocket_connectFailed(self, ETIMEDOUT);
+   }
+   else if(timer == &self->rxShrinkTimer){
+      msocket_rxShrinkTimeout(self);
+   }
+   else if(callback != 0){
+      callback(self->handlerArg, timer);
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : 0;
+}
+
+/**
+ * Called by the I/O driver once it no longer serves the socket.
+ */
+void msocket_ioStopped(msocket_t *self){
+   MUTEX_LOCK(self->mutex);
+   self->threadRunning = 0;
+   MUTEX_UNLOCK(self->mutex);
+}
+
+#ifdef __linux__
+/**
+ * Called by a reactor that is destroyed while the socket is still attached to it.
+ */
+void msocket_ioForgetReactor(msocket_t *self){
+   MUTEX_LOCK(self->mutex);
+   self->reactor = (struct msocket_reactor_tag*) 0;
+   MUTEX_UNLOCK(self->mutex);
+}
+#endif
+
+static int8_t msocket_startIoThread(msocket_t *self){
+   if( (self != 0) && (self->handlerTable != 0) && (self->threadRunning == 0) ){
+#ifdef _WIN32
+      if(self->state == MSOCKET_STATE_LISTENING){
+         msocket_setNonBlocking(self->tcpsockfd); //accept must never block the I/O thread
+      }
+#else
+      if( (self->socketMode & MSOCKET_MODE_TCP) != 0){
+         msocket_setNonBlocking(self->tcpsockfd); //the I/O driver accepts, receives and sends only on readiness
+      }
+#endif
+#ifdef __linux__
+      if (self->reactor != 0){
+         self->threadRunning = 1;
+         if (msocket_reactor_attach(self->reactor, self) != 0){
+            self->threadRunning = 0;
+            return -1;
+         }
+         return 0;
+      }
+#endif
+#ifdef _WIN32
+      THREAD_CREATE(self->ioThread,ioTask,self,self->ioThreadId);
+      if(self->ioThread == INVALID_HANDLE_VALUE){
+         return -1;
+      }
+#else
+      int rc;
+      if(msocket_wakeupOpen(self) != 0){
+         return -1;
+      }
+      rc = THREAD_CREATE(self->ioThread,ioTask,self);
+      if(rc != 0){
+         msocket_wakeupClose(self);
+         return -1;
+      }
+#endif
+      self->threadRunning = 1;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+static int msocket_udpRxHandler(msocket_t *self,uint8_t *recvBuf, int len){
+   if((self != 0) && (len > 0) && (self->handlerTable->udp_msg != 0)){
+      self->handlerTable->udp_msg(self->handlerArg,&self->udpInfo.addr[0],self->udpInfo.port,recvBuf,(uint32_t) len);
+      return 0;
+   }
+   return -1;
+}
+
+#ifdef __linux__
+/**
+ * Receives up to MSOCKET_UDP_BATCH_MAX datagrams with a single recvmmsg call. They are passed to udp_msg_batch in one
+ * call when it is set, otherwise one by one to udp_msg. Datagrams longer than MSOCKET_IO_BUF_SIZE are truncated.
+ */
+static int msocket_udpReceiveBatch(msocket_t *self){
+   msocket_udpbatch_t *batch = self->udpBatch;
+   int count;
+   int i;
+   if( (self->handlerTable->udp_msg_batch == 0) && (self->handlerTable->udp_msg == 0) ){
+      return -1;
+   }
+   if(batch == 0){
+      batch = (msocket_udpbatch_t*) malloc(sizeof(msocket_udpbatch_t) + MSOCKET_UDP_BATCH_MAX * MSOCKET_IO_BUF_SIZE);
+      if(batch == 0){
+         return -1;
+      }
+      memset(&batch->msgs[0], 0, sizeof(batch->msgs));
+      for(i = 0; i < MSOCKET_UDP_BATCH_MAX; i++){
+         batch->iov[i].iov_base = &batch->data[i * MSOCKET_IO_BUF_SIZE];
+         batch->iov[i].iov_len = MSOCKET_IO_BUF_SIZE;
+         batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+         batch->msgs[i].msg_hdr.msg_iovlen = 1;
+         batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+      }
+      self->udpBatch = batch;
+   }
+   for(i = 0; i < MSOCKET_UDP_BATCH_MAX; i++){
+      batch->msgs[i].msg_hdr.msg_namelen = (socklen_t) sizeof(struct sockaddr_storage); //overwritten by the kernel
+   }
+   count = recvmmsg(self->udpsockfd, &batch->msgs[0], MSOCKET_UDP_BATCH_MAX, MSG_DONTWAIT, (struct timespec*) 0);
+   if(count <= 0){
+      return 0; //nothing to read or receive error, ignored like a failed recvfrom
+   }
+   if(self->handlerTable->udp_msg_batch != 0){
+      for(i = 0; i < count; i++){
+         batch->datagrams[i].data = (const uint8_t*) batch->iov[i].iov_base;
+         batch->datagrams[i].len = (uint32_t) batch->msgs[i].msg_len;
+         batch->datagrams[i].addr = (const struct sockaddr*) &batch->addrs[i];
+         batch->datagrams[i].addrLen = (uint32_t) batch->msgs[i].msg_hdr.msg_namelen;
+      }
+      self->handlerTable->udp_msg_batch(self->handlerArg, &batch->datagrams[0], (uint32_t) count);
+      return 0;
+   }
+   for(i = 0; i < count; i++){
+      msocket_udpSetPeer(self, (const struct sockaddr*) &batch->addrs[i]);
+      if(msocket_udpRxHandler(self, (uint8_t*) batch->iov[i].iov_base, (int) batch->msgs[i].msg_len) < 0){
+         return -1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Sets udpInfo to the sender of a datagram before it is passed to udp_msg
+ */
+static void msocket_udpSetPeer(msocket_t *self, const struct sockaddr *addr){
+   if(addr->sa_family == AF_INET6){
+      const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6*) addr;
+      self->udpInfo.port = ntohs(addr6->sin6_port);
+      inet_ntop(AF_INET6, &(addr6->sin6_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
+   }
+   else{
+      const struct sockaddr_in *addr4 = (const struct sockaddr_in*) addr;
+      self->udpInfo.port = ntohs(addr4->sin_port);
+      inet_ntop(AF_INET, &(addr4->sin_addr), &self->udpInfo.addr[0], INET6_ADDRSTRLEN);
+   }
+}
+#endif
+
+/**
+ * Accepts new connections on listening socket served by msocket_start_io.
+ * The socket is non-blocking, the accept queue is drained (up to MSOCKET_ACCEPT_BATCH_MAX connections) on each readiness event.
+ */
+static int msocket_acceptHandler(msocket_t *self){
+   int count;
+   for(count = 0; count < MSOCKET_ACCEPT_BATCH_MAX; count++){
+      struct sockaddr_storage addr;
+      SOCK_LEN_T addrLen = (SOCK_LEN_T) sizeof(addr);
+      SOCKET_T sockfd;
+      memset(&addr, 0, sizeof(addr));
+      sockfd = msocket_acceptSocket(self->tcpsockfd, (struct sockaddr*) &addr, &addrLen);
+      if (IS_INVALID_SOCKET(sockfd)){
+#ifndef _WIN32
+         if( (errno == ECONNABORTED) || (errno == EINTR) ){
+            continue; //connection was reset while waiting in the queue
+         }
+#endif
+         break; //queue is empty (or listening socket was closed)
+      }
+      (void) msocket_ioAccepted(self, sockfd, (const struct sockaddr*) &addr);
+      if (msocket_state(self) == MSOCKET_STATE_CLOSING){
+         break;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Receives into the free space at the end of tcpRxBuf so the data is not copied before tcp_data sees it.
+ * At least rxSize bytes are requested. recvBuf is only used when the data is handed over to a workpool, which needs its own copy anyway.
+ */
+static int msocket_tcpReceive(msocket_t *self, uint8_t *recvBuf, uint32_t bufSize){
+   int rc;
+   uint32_t tailLen;
+   uint32_t reserveLen;
+#ifndef _WIN32
+   if( (msocket_hasDataHandler(self) == 0u) || (self->workpool != 0) ){
+#else
+   if(msocket_hasDataHandler(self) == 0u){
+#endif
+      rc = recv(self->tcpsockfd, (char*) &recvBuf[0], bufSize, 0);
+      return msocket_ioReceived(self, recvBuf, rc);
+   }
+   reserveLen = msocket_framer_remain(&self->framer); //rest of a partially received frame
+   if(reserveLen < self->rxSize){
+      reserveLen = self->rxSize;
+   }
+   if( (msocket_bytequeue_reserveTail(&self->tcpRxBuf, reserveLen) != 0) && (msocket_bytequeue_tailLength(&self->tcpRxBuf) == 0u) ){
+      return -1; //out of memory or message larger than the fixed size ring buffer
+   }
+   tailLen = msocket_bytequeue_tailLength(&self->tcpRxBuf);
+   rc = recv(self->tcpsockfd, (char*) msocket_bytequeue_tail(&self->tcpRxBuf), (int) tailLen, 0);
+   if(rc > 0){
+      (void) msocket_bytequeue_commit(&self->tcpRxBuf, (uint32_t) rc);
+      if((uint32_t) rc == tailLen){
+         msocket_rxGrow(self);
+      }
+      else if(self->tcpRxBuf.u32AllocLen - msocket_bytequeue_length(&self->tcpRxBuf) > self->rxSize * 2u){
+         msocket_rxShrinkStart(self); //buffer grew for a large message, give the memory back once it is quiet
+      }
+   }
+   return msocket_ioReceived(self, (uint8_t*) 0, rc);
+}
+
+/**
+ * A receive filled all free space of tcpRxBuf, more data is probably waiting. Runs on the I/O driver thread.
+ */
+static void msocket_rxGrow(msocket_t *self){
+   if(self->rxSize < self->rxSizeMax){
+      self->rxSize = (self->rxSize > self->rxSizeMax / 2u)? self->rxSizeMax : self->rxSize * 2u;
+   }
+   self->rxBusy = 1u;
+   msocket_rxShrinkStart(self);
+}
+
+static void msocket_rxShrinkStart(msocket_t *self){
+   msocket_timerLock(self);
+   if( (self->timerWheel != 0) && (msocket_timer_is_running(&self->rxShrinkTimer) == 0) ){
+      //added from the driver's own thread, the new expiry time is picked up before it waits again
+      msocket_timerwheel_add(self->timerWheel, &self->rxShrinkTimer, msocket_timestamp() + MSOCKET_RX_SHRINK_MS, &self->timers);
+   }
+   msocket_timerUnlock(self);
+}
+
+/**
+ * Halves the receive size when no receive was full during the last period and releases receive buffer memory beyond it.
+ */
+static void msocket_rxShrinkTimeout(msocket_t *self){
+   if(self->rxBusy != 0u){
+      self->rxBusy = 0u;
+   }
+   else{
+      self->rxSize = (self->rxSize / 2u < self->rxSizeMin)? self->rxSizeMin : self->rxSize / 2u;
+      (void) msocket_bytequeue_shrink(&self->tcpRxBuf, self->rxSize);
+      if(self->rxSize == self->rxSizeMin){
+         return; //back to the minimum, the next full receive restarts the timer
+      }
+   }
+   msocket_rxShrinkStart(self);
+}
+
+static int msocket_tcpRxHandler(msocket_t *self,uint8_t *recvBuf, int len){
+   if( len < 0 ){
+#ifdef _WIN32
+      int lastError = WSAGetLastError();
+      if (lastError == WSAECONNRESET)
+      {
+         len = 0; //change to socket closed event
+      }
+      else
+      {
+#if(MSOCKET_DEBUG)
+         fprintf(stderr, "[MSOCKET] recv error %d\n", lastError);
+#endif
+         return -1;
+      }
+#else
+      if(errno == ECONNRESET){
+         len = 0; //change to socket closed event
+      }
+      else if( (errno == EAGAIN) || (errno == EWOULDBLOCK) ){
+         return 0; //the socket is non-blocking, readiness was reported but no data was left to read
+      }
+      else{
+#if(MSOCKET_DEBUG)
+         perror("msocket: recv error");
+#endif
+         return -1;
+      }
+#endif
+   }
+   if( self != 0 ){
+      if( len == 0 ){
+         int8_t triggerCallback = 1u;
+         MUTEX_LOCK(self->mutex);
+         if (self->state == MSOCKET_STATE_CLOSING) {
+            triggerCallback = 0;
+         }
+         self->state = MSOCKET_STATE_CLOSING;
+         MUTEX_UNLOCK(self->mutex);
+         if( (triggerCallback != 0) && (self->handlerTable->tcp_disconnected != 0) ){
+#ifndef _WIN32
+            if(self->workpool != 0){
+               (void) msocket_workpool_post(self->workpool, self, (const uint8_t*) 0, 0u); //delivered after queued data
+               return -1;
+            }
+#endif
+            self->handlerTable->tcp_disconnected(self->handlerArg);
+         }
+         return -1;
+      }
+      else if(msocket_hasDataHandler(self) != 0u){
+#ifndef _WIN32
+         if(self->workpool != 0){
+            msocket_rxQueueUpdate(self, (uint32_t) len, 0u); //counted first, the worker may be done with it before post returns
+            return msocket_workpool_post(self->workpool, self, recvBuf, (uint32_t) len);
+         }
+#endif
+         self->rxBudgetLeft = (self->rxBudget != 0u)? self->rxBudget : UINT32_MAX;
+         if(msocket_tcpParse(self, recvBuf, (uint32_t) len) < 0){
+            return -1;
+         }
+         if( (self->rxLimit != 0u) && (msocket_bytequeue_length(&self->tcpRxBuf) >= self->rxLimit) && (self->rxBacklog == 0u) &&
+             (msocket_rxIsPaused(self) == 0u) ){
+            MUTEX_LOCK(self->mutex);
+            self->state = MSOCKET_STATE_CLOSING;
+            MUTEX_UNLOCK(self->mutex);
+            errno = EMSGSIZE;
+            return -1; //incomplete message as large as the limit
+         }
+      }
+   }
+   return 0;
+}
+
+#ifndef _WIN32
+/**
+ * Sends directly while the send queue is empty, queues whatever the socket does not take without blocking.
+ * When cursor refers to the data of buf, the queue keeps a reference to buf instead of copying the data.
+ * With zerocopy set the direct sends use MSG_ZEROCOPY (Linux), then 1 is returned when the kernel kept a reference to
+ * the caller's buffer and tcp_send_complete will be called with cookie.
+ */
+static int8_t msocket_sendQueued(msocket_t *self, msocket_iovcursor_t *cursor, msocket_buf_t *buf, uint8_t zerocopy, uint32_t cookie){
+   uint8_t notify = 0u;
+   int8_t retval = 0;
+   int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#ifdef __linux__
+   uint32_t zcSends = 0u;
+   msocket_zcitem_t *zcItem = (msocket_zcitem_t*) 0;
+   if(zerocopy != 0u){
+      zcItem = (msocket_zcitem_t*) malloc(sizeof(msocket_zcitem_t));
+      if(zcItem != 0){
+         flags |= MSG_ZEROCOPY;
+      }
+   }
+#else
+   (void) zerocopy;
+   (void) cookie;
+#endif
+   MUTEX_LOCK(self->mutex);
+   if( (self->state != MSOCKET_STATE_ESTABLISHED) && (self->state != MSOCKET_STATE_PENDING) ){
+      MUTEX_UNLOCK(self->mutex);
+#ifdef __linux__
+      free(zcItem);
+#endif
+      errno = ENOTCONN;
+      return -1;
+   }
+   if( (self->txHead == 0) && (self->txSending == 0u) && (self->state == MSOCKET_STATE_ESTABLISHED) ){
+      while(cursor->remain > 0u){
+         ssize_t n = msocket_iovSend(self->tcpsockfd, cursor, flags);
+         if(n < 0){
+            if(errno == EINTR){
+               continue;
+            }
+            if( (errno == EAGAIN) || (errno == EWOULDBLOCK) ){
+               break;
+            }
+#ifdef __linux__
+            if( (errno == ENOBUFS) && ( (flags & MSG_ZEROCOPY) != 0) ){
+               flags &= ~MSG_ZEROCOPY; //locked memory limit reached, copy the rest
+               continue;
+            }
+            if(zcSends > 0u){
+               int error = errno;
+               msocket_zcAppend(self, zcItem, zcSends, cookie); //kernel still holds the pages of what was already sent
+               zcItem = (msocket_zcitem_t*) 0;
+               MUTEX_UNLOCK(self->mutex);
+               if(self->reactor != 0){
+                  msocket_reactor_want_errors(self->reactor, self);
+               }
+               errno = error;
+               return -1;
+            }
+            free(zcItem);
+#endif
+            MUTEX_UNLOCK(self->mutex);
+#if(MSOCKET_DEBUG)
+            perror("msocket: send failed: ");
+#endif
+            return -1;
+         }
+#ifdef __linux__
+         if( (flags & MSG_ZEROCOPY) != 0){
+            zcSends++;
+         }
+#endif
+      }
+   }
+   if(cursor->remain > 0u){
+      uint32_t len = cursor->remain;
+      msocket_txitem_t *item = (msocket_txitem_t*) malloc(sizeof(msocket_txitem_t) + ( (buf != 0)? 0u : len) );
+      if(item == 0){
+         MUTEX_UNLOCK(self->mutex);
+#ifdef __linux__
+         free(zcItem);
+#endif
+         errno = ENOMEM;
+         return -1;
+      }
+      item->next = (msocket_txitem_t*) 0;
+#ifdef __linux__
+      item->fd = -1;
+#endif
+      if(buf != 0){
+         item->buf = msocket_buf_ref(buf);
+         item->len = buf->len;
+         item->offset = buf->len - len;
+      }
+      else{
+         item->buf = (msocket_buf_t*) 0;
+         item->len = len;
+         item->offset = 0u;
+         msocket_iovCopy(cursor, &item->data[0]);
+      }
+      if(self->txTail == 0){
+         self->txHead = item;
+         notify = 1u; //I/O driver needs to start waiting for writability
+      }
+      else{
+         self->txTail->next = item;
+      }
+      self->txTail = item;
+      self->txQueued += len;
+      if(self->txQueued > self->txHighWater){
+         self->txBlocked = 1u;
+      }
+   }
+#ifdef __linux__
+   if(zcSends > 0u){
+      msocket_zcAppend(self, zcItem, zcSends, cookie);
+      zcItem = (msocket_zcitem_t*) 0;
+      retval = 1;
+   }
+#endif
+   msocket_timeoutReset(self);
+   MUTEX_UNLOCK(self->mutex);
+#ifdef __linux__
+   free(zcItem);
+   if( (retval > 0) && (self->reactor != 0) ){
+      msocket_reactor_want_errors(self->reactor, self); //ioTask and epoll always report POLLERR
+   }
+#endif
+   if(notify != 0u){
+      msocket_txNotify(self);
+   }
+   return retval;
+}
+
+#ifdef __linux__
+/**
+ * sendfile on a socket served by an I/O driver, which is non-blocking. Returns -1 with errno=EIO when the file ends
+ * before len bytes were sent.
+ */
+static ssize_t msocket_sendFileChunk(SOCKET_T sockfd, int fd, off_t *offset, size_t len){
+   ssize_t n = sendfile(sockfd, fd, offset, len);
+   if( (n == 0) && (len > 0u) ){
+      errno = EIO;
+      return -1;
+   }
+   return n;
+}
+#endif
+
+/**
+ * Returns -1 if the fragments add up to more than what fits in uint32_t
+ */
+static int8_t msocket_iovInit(msocket_iovcursor_t *cursor, const struct iovec *iov, int iovcnt){
+   uint64_t total = 0u;
+   int i;
+   for(i = 0; i < iovcnt; i++){
+      total += iov[i].iov_len;
+   }
+   if(total > UINT32_MAX){
+      return -1;
+   }
+   cursor->iov = iov;
+   cursor->iovcnt = iovcnt;
+   cursor->offset = 0u;
+   cursor->remain = (uint32_t) total;
+   return 0;
+}
+
+/**
+ * Sends the next (up to IOV_BATCH_MAX) fragments with one sendmsg call and moves the cursor past the bytes the socket took.
+ */
+static ssize_t msocket_iovSend(SOCKET_T sockfd, msocket_iovcursor_t *cursor, int flags){
+   struct iovec iov[IOV_BATCH_MAX];
+   struct msghdr msg;
+   ssize_t n;
+   size_t sent;
+   int i;
+   for(i = 0; (i < cursor->iovcnt) && (i < IOV_BATCH_MAX); i++){
+      iov[i] = cursor->iov[i];
+   }
+   iov[0].iov_base = (uint8_t*) iov[0].iov_base + cursor->offset;
+   iov[0].iov_len -= cursor->offset;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov[0];
+   msg.msg_iovlen = i;
+   n = sendmsg(sockfd, &msg, flags);
+   if(n <= 0){
+      return n;
+   }
+   cursor->remain -= (uint32_t) n;
+   sent = (size_t) n + cursor->offset;
+   while( (cursor->iovcnt > 0) && (sent >= cursor->iov[0].iov_len) ){
+      sent -= cursor->iov[0].iov_len;
+      cursor->iov++;
+      cursor->iovcnt--;
+   }
+   cursor->offset = sent;
+   return n;
+}
+
+/**
+ * Copies the bytes not yet sent to dest, which must have room for cursor->remain bytes
+ */
+static void msocket_iovCopy(const msocket_iovcursor_t *cursor, uint8_t *dest){
+   size_t offset = cursor->offset;
+   int i;
+   for(i = 0; i < cursor->iovcnt; i++){
+      size_t len = cursor->iov[i].iov_len - offset;
+      memcpy(dest, (const uint8_t*) cursor->iov[i].iov_base + offset, len);
+      dest += len;
+      offset = 0u;
+   }
+}
+
+/**
+ * Makes the I/O driver wait for the socket to become writable
+ */
+static void msocket_txNotify(msocket_t *self){
+#ifdef __linux__
+   if(self->reactor != 0){
+      msocket_reactor_want_write(self->reactor, self);
+      return;
+   }
+#endif
+   if(msocket_isIoThread(self) == 0){
+      MUTEX_LOCK(self->mutex);
+      msocket_wakeupSignal(self);
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+#endif
+
+#ifdef __linux__
+/**
+ * Forgets zero-copy sends waiting for completion. Caller must hold the mutex (or be the only user of the socket).
+ */
+static void msocket_zcClear(msocket_t *self){
+   while(self->zcHead != 0){
+      msocket_zcitem_t *item = self->zcHead;
+      self->zcHead = item->next;
+      free(item);
+   }
+   self->zcTail = (msocket_zcitem_t*) 0;
+}
+
+/**
+ * Records that the next sends MSG_ZEROCOPY sends used the buffer of cookie, tcp_send_complete is called once the
+ * kernel reports the last of them as done. Caller must hold the mutex.
+ */
+static void msocket_zcAppend(msocket_t *self, msocket_zcitem_t *item, uint32_t sends, uint32_t cookie){
+   self->zcNextId += sends;
+   item->next = (msocket_zcitem_t*) 0;
+   item->lastId = self->zcNextId - 1u;
+   item->cookie = cookie;
+   if(self->zcTail == 0){
+      self->zcHead = item;
+   }
+   else{
+      self->zcTail->next = item;
+   }
+   self->zcTail = item;
+}
+
+/**
+ * Triggers tcp_send_complete for a list of zero-copy sends and frees it. Caller must not hold the mutex.
+ */
+static void msocket_zcComplete(msocket_t *self, msocket_zcitem_t *items){
+   while(items != 0){
+      msocket_zcitem_t *next = items->next;
+      if(self->handlerTable->tcp_send_complete != 0){
+         self->handlerTable->tcp_send_complete(self->handlerArg, items->cookie);
+      }
+      free(items);
+      items = next;
+   }
+}
+
+/**
+ * Completes all zero-copy sends when the socket is closed: completions that already arrived on the error queue are
+ * delivered first, the remaining sends are then reported as well since no completion will follow for them.
+ * Called by msocket_close after the I/O driver has stopped.
+ */
+static void msocket_zcFlush(msocket_t *self){
+   msocket_zcitem_t *items;
+   if(msocket_ioZerocopyPending(self) == 0u){
+      return;
+   }
+   (void) msocket_ioErrQueue(self);
+   MUTEX_LOCK(self->mutex);
+   items = self->zcHead;
+   self->zcHead = (msocket_zcitem_t*) 0;
+   self->zcTail = (msocket_zcitem_t*) 0;
+   MUTEX_UNLOCK(self->mutex);
+   msocket_zcComplete(self, items);
+}
+#endif
+
+/**
+ * Frees a send queue item and releases the file or shared buffer it refers to
+ */
+static void msocket_txFree(msocket_txitem_t *item){
+   if(item->buf != 0){
+      msocket_buf_unref(item->buf);
+   }
+#ifdef __linux__
+   if(item->fd >= 0){
+      close(item->fd);
+   }
+#endif
+   free(item);
+}
+
+/**
+ * Frees all items in send queue. Caller must hold the mutex (or be the only user of the socket).
+ */
+static void msocket_txClear(msocket_t *self){
+   while(self->txHead != 0){
+      msocket_txitem_t *item = self->txHead;
+      self->txHead = item->next;
+      msocket_txFree(item);
+   }
+   self->txTail = (msocket_txitem_t*) 0;
+   self->txQueued = 0u;
+   self->txBlocked = 0u;
+}
+
+/**
+ * Lets tcp_data parse received data. Returns -1 when the socket needs to be closed, otherwise the number of bytes at
+ * the end of data that did not fit into a full ring buffer while reading is paused (only possible for workpool chunks,
+ * the I/O driver never receives more than fits, see msocket_ioRecvSize).
+ * data=0 means the data has already been received into tcpRxBuf. Otherwise, when tcpRxBuf is empty, tcp_data parses
+ * data where it is and only an incomplete message at the end is copied into tcpRxBuf.
+ */
+static int msocket_tcpParse(msocket_t *self, const uint8_t *data, uint32_t len){
+   if(data == 0){
+      return msocket_tcpParseQueue(self);
+   }
+   if(msocket_bytequeue_length(&self->tcpRxBuf) == 0u){
+      while(len > 0u){
+         uint32_t parseLen = 0;
+         int rc = msocket_tcpData(self, data, len, &parseLen);
+         if(rc < 0){
+            return -1;
+         }
+         assert(parseLen<=len);
+         data += parseLen;
+         len -= parseLen;
+         if( (parseLen == 0) || (self->rxBudgetLeft == 0u) || (rc > 0) ){
+            break; //incomplete message, read budget used up or reading paused, the rest goes into tcpRxBuf
+         }
+      }
+   }
+   while(len > 0u){
+      uint32_t chunkLen = len;
+      uint32_t reserveLen = len;
+      if(msocket_framer_remain(&self->framer) <= UINT32_MAX - len){
+         reserveLen += msocket_framer_remain(&self->framer); //make room for the rest of the frame as well
+      }
+      if(msocket_bytequeue_reserveTail(&self->tcpRxBuf, reserveLen) != 0){
+         uint32_t tailLen = msocket_bytequeue_tailLength(&self->tcpRxBuf); //fixed size ring buffer, take what fits and parse it first
+         if(tailLen == 0u){
+            uint32_t bufferedLen = msocket_bytequeue_length(&self->tcpRxBuf);
+            if(msocket_rxIsPaused(self) != 0u){
+               return (int) len; //ring is full of messages held back by the pause, the caller keeps the rest
+            }
+            if(self->rxBacklog != 0u){
+               self->rxBudgetLeft = self->rxBudget; //ring is full of messages held back by the read budget, deliver another budget
+            }
+            if(msocket_tcpParseQueue(self) < 0){
+               return -1;
+            }
+            if( (msocket_bytequeue_length(&self->tcpRxBuf) == bufferedLen) && (msocket_rxIsPaused(self) == 0u) ){
+               return -1; //message larger than tcpRxBuf
+            }
+            continue;
+         }
+         if(tailLen < chunkLen){
+            chunkLen = tailLen;
+         }
+      }
+      (void) msocket_bytequeue_append(&self->tcpRxBuf, data, chunkLen);
+      data += chunkLen;
+      len -= chunkLen;
+      if(msocket_tcpParseQueue(self) < 0){
+         return -1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Lets tcp_data parse the data in tcpRxBuf. Returns -1 when the socket needs to be closed.
+ */
+static int msocket_tcpParseQueue(msocket_t *self){
+   self->rxBacklog = 0u;
+   if(msocket_rxIsPaused(self) != 0u){
+      return 0; //left in tcpRxBuf until msocket_resume_read
+   }
+   while(1){
+      //message parse loop
+      uint32_t parseLen = 0;
+      uint32_t u32Len;
+      int rc;
+      const uint8_t *pBegin = (const uint8_t*) msocket_bytequeue_data(&self->tcpRxBuf);
+      u32Len = msocket_bytequeue_length(&self->tcpRxBuf);
+      if(u32Len == 0){
+         break; //no more data
+      }
+      if(self->rxBudgetLeft == 0u){
+         self->rxBacklog = 1u; //the I/O driver calls msocket_ioBacklog for the rest
+         break;
+      }
+      rc = msocket_tcpData(self, pBegin, u32Len, &parseLen);
+      if( (rc >= 0) && (parseLen > 0) ){
+         assert(parseLen<=u32Len);
+         (void) msocket_bytequeue_consume(&self->tcpRxBuf, parseLen); //O(1), compaction is left to the next receive
+      }
+      if( (self->rxBlock != 0) && (msocket_rxRenew(self) < 0) ){
+         rc = -1;
+      }
+      if(rc < 0){
+         return -1;
+      }
+      if( (parseLen == 0) || (rc > 0) ){
+         break;
+      }
+   }
+   return 0;
+}
+
+/**
+ * The handler kept the receive buffer through msocket_rx_retain, hands it over and continues in a fresh one.
+ * Unparsed data is moved to the fresh buffer. Returns -1 when there was no memory for it.
+ */
+static int msocket_rxRenew(msocket_t *self){
+   int rc = 0;
+   msocket_rxblock_t *block = self->rxBlock;
+   uint8_t *pNewData = (uint8_t*) 0;
+   uint32_t newLen = 0u;
+#ifndef _WIN32
+   uint32_t minLen = msocket_bytequeue_length(&self->tcpRxBuf);
+   msocket_rxblock_t **pp;
+   if(minLen < self->rxSize){
+      minLen = self->rxSize;
+   }
+   pthread_mutex_lock(&m_rxPoolMutex);
+   for(pp = &m_rxPool; *pp != 0; pp = &(*pp)->next){
+      if((*pp)->size >= minLen){
+         msocket_rxblock_t *pooled = *pp;
+         *pp = pooled->next;
+         m_rxPoolCount--;
+         pNewData = pooled->data;
+         newLen = pooled->size;
+         free(pooled);
+         break;
+      }
+   }
+   pthread_mutex_unlock(&m_rxPoolMutex);
+#endif
+   self->rxBlock = (msocket_rxblock_t*) 0;
+   if(msocket_bytequeue_swap(&self->tcpRxBuf, pNewData, newLen) == 0){
+      msocket_bytequeue_clear(&self->tcpRxBuf); //unparsed data is lost, the socket is closed
+      (void) msocket_bytequeue_swap(&self->tcpRxBuf, (uint8_t*) 0, 0u);
+      rc = -1;
+   }
+   msocket_rxblockUnref(block);
+   return rc;
+}
+
+/**
+ * Frees a receive buffer once neither the socket nor any msocket_buf_t refers to it, or keeps it in the pool for reuse.
+ */
+static void msocket_rxblockUnref(msocket_rxblock_t *block){
+   if(ATOMIC_DEC(block->refCount) == 0u){
+#ifndef _WIN32
+      if(block->size <= MSOCKET_RX_SIZE_MAX){
+         pthread_mutex_lock(&m_rxPoolMutex);
+         if(m_rxPoolCount < RX_POOL_MAX){
+            block->next = m_rxPool;
+            m_rxPool = block;
+            m_rxPoolCount++;
+            block = (msocket_rxblock_t*) 0;
+         }
+         pthread_mutex_unlock(&m_rxPoolMutex);
+      }
+      if(block == 0){
+         return;
+      }
+#endif
+      free(block->data);
+      free(block);
+   }
+}
+
+/**
+ * Returns 1 while received messages are held back from the handler. The rxLimit pause only stops the I/O driver.
+ */
+static uint8_t msocket_rxIsPaused(msocket_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = ( (self->rxPaused & RX_PAUSE_USER) != 0u)? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+
+/**
+ * Lets the I/O driver know that it may receive from the socket again. On Windows the driver finds out by itself within MSOCKET_IO_TIMEOUT_MS.
+ */
+static void msocket_rxNotify(msocket_t *self){
+#ifdef __linux__
+   if(self->reactor != 0){
+      msocket_reactor_want_read(self->reactor, self);
+      return;
+   }
+#endif
+#ifndef _WIN32
+   if(msocket_isIoThread(self) == 0){
+      MUTEX_LOCK(self->mutex);
+      msocket_wakeupSignal(self);
+      MUTEX_UNLOCK(self->mutex);
+   }
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * Keeps count of received bytes handed to the workpool that the handler has not consumed yet. Reading is paused while
+ * the count is at rxLimit and resumed once the workers have brought it down to half of it.
+ */
+static void msocket_rxQueueUpdate(msocket_t *self, uint32_t added, uint32_t removed){
+   uint8_t resumed = 0u;
+   MUTEX_LOCK(self->mutex);
+   self->rxQueued = self->rxQueued + added - removed;
+   if( (self->rxLimit != 0u) && (self->rxQueued >= self->rxLimit) ){
+      self->rxPaused |= RX_PAUSE_LIMIT;
+   }
+   else if( ( (self->rxPaused & RX_PAUSE_LIMIT) != 0u) && (self->rxQueued <= self->rxLimit / 2u) ){
+      self->rxPaused &= (uint8_t) ~RX_PAUSE_LIMIT;
+      resumed = (self->rxPaused == 0u)? 1u : 0u;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if(resumed != 0u){
+      msocket_rxNotify(self);
+   }
+}
+#endif
+
+/**
+ * Returns 1 when the handler takes received TCP data, either raw through tcp_data or as messages through tcp_message or tcp_data_batch
+ */
+static uint8_t msocket_hasDataHandler(msocket_t *self){
+   if(self->framer.type != MSOCKET_FRAMER_NONE){
+      return ( (self->handlerTable->tcp_message != 0) || (self->handlerTable->tcp_data_batch != 0) )? 1u : 0u;
+   }
+   return (self->handlerTable->tcp_data != 0)? 1u : 0u;
+}
+
+/**
+ * Returns -1 when the socket needs to be closed and 1 when the handler paused reading, either by returning
+ * MSOCKET_RX_PAUSE from tcp_message/tcp_data_batch or by calling msocket_pause_read.
+ */
+static int msocket_tcpData(msocket_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen){
+   int8_t rc;
+   self->framer.budget = self->rxBudgetLeft;
+   if( (self->framer.type != MSOCKET_FRAMER_NONE) && (self->handlerTable->tcp_data_batch != 0) ){
+      rc = msocket_framer_decode_batch(&self->framer, data, len, parseLen, self->handlerTable->tcp_data_batch, self->handlerArg);
+      self->rxBudgetLeft = self->framer.budget;
+   }
+   else if(self->framer.type != MSOCKET_FRAMER_NONE){
+      rc = msocket_framer_decode(&self->framer, data, len, parseLen, self->handlerTable->tcp_message, self->handlerArg);
+      self->rxBudgetLeft = self->framer.budget;
+   }
+   else{
+      rc = self->handlerTable->tcp_data(self->handlerArg, data, len, parseLen);
+      self->rxBudgetLeft--;
+      if(rc != 0){
+         rc = -1; //any non-zero return of tcp_data closes the socket
       }
-      free(recvBuf);
    }
-# if(MSOCKET_DEBUG)
-   printf("[MSOCKET](0x%p) ioTask exiting\n",arg);
+   if(rc < 0){
+      MUTEX_LOCK(self->mutex);
+      self->state = MSOCKET_STATE_CLOSING;
+      MUTEX_UNLOCK(self->mutex);
+      return -1;
+   }
+   MUTEX_LOCK(self->mutex);
+   if(rc > 0){
+      self->rxPaused |= RX_PAUSE_USER;
+   }
+   rc = ( (self->rxPaused & RX_PAUSE_USER) != 0u)? 1 : 0; //the handler may also have called msocket_pause_read
+   MUTEX_UNLOCK(self->mutex);
+   return rc;
+}
+
+#ifndef _WIN32
+/**
+ * Processes work that the I/O driver handed to the socket's workpool, runs on a worker thread. len=0 means the peer disconnected,
+ * len=MSOCKET_WORK_RESUME (without data) that reading was resumed.
+ * Returns the number of bytes at the end of data that were not taken because reading is paused and the rx ring is full.
+ */
+uint32_t msocket_ioWork(msocket_t *self, const uint8_t *data, uint32_t len){
+   uint32_t bufferedLen;
+   uint32_t restLen;
+   int rc;
+   if(self->workFailed != 0){
+      return 0u;
+   }
+   if(len == 0u){
+      if( (msocket_bytequeue_length(&self->tcpRxBuf) > 0u) && (msocket_rxIsPaused(self) != 0u) ){
+         self->workDisconnected = 1u; //after what is left in tcpRxBuf, once reading is resumed
+      }
+      else if(self->handlerTable->tcp_disconnected != 0){
+         self->handlerTable->tcp_disconnected(self->handlerArg);
+      }
+      return 0u;
+   }
+   if(len == MSOCKET_WORK_RESUME){
+      data = (const uint8_t*) 0; //delivers what is left in tcpRxBuf
+      len = 0u;
+   }
+   self->rxBudgetLeft = UINT32_MAX; //workers take turns between sockets in MSOCKET_WORKPOOL_BATCH_SIZE steps instead
+   bufferedLen = msocket_bytequeue_length(&self->tcpRxBuf);
+   rc = msocket_tcpParse(self, data, len);
+   restLen = (rc > 0)? (uint32_t) rc : 0u; //still queued, stays counted in rxQueued
+   msocket_rxQueueUpdate(self, msocket_bytequeue_length(&self->tcpRxBuf), len - restLen + bufferedLen);
+   if( (rc == 0) && (self->workDisconnected != 0u) && (msocket_rxIsPaused(self) == 0u) ){
+      self->workDisconnected = 0u;
+      if(self->handlerTable->tcp_disconnected != 0){
+         self->handlerTable->tcp_disconnected(self->handlerArg);
+      }
+   }
+   if(rc < 0){
+      self->workFailed = 1u;
+      MUTEX_LOCK(self->mutex);
+      self->state = MSOCKET_STATE_CLOSING;
+      if(self->socketMode & MSOCKET_MODE_TCP){
+         SOCKET_SHUTDOWN(self->tcpsockfd); //the I/O driver stops serving the socket once it sees the shutdown
+      }
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return restLen;
+}
 #endif
-   THREAD_RETURN(0);
+
+void msocket_timeoutReset(msocket_t *self){
+   if(self != 0){
+      self->inactivityMs=0;
+      self->inactivityCallMs=TIMEOUT_CALL_INTERVAL_MS;
+      self->lastActivityMs=msocket_timestamp();
+   }
 }
 
-static int8_t msocket_startIoThread(msocket_t *self){
-   if( (self != 0) && (self->handlerTable != 0) && (self->threadRunning == 0) ){
-#ifdef _WIN32
-      THREAD_CREATE(self->ioThread,ioTask,self,self->ioThreadId);
-      if(self->ioThread == INVALID_HANDLE_VALUE){
-         return -1;
+/**
+ * Returns 1 when the inactivity callback is due, elapsed is then set to the inactivity period that was reached.
+ */
+static uint8_t msocket_timeoutUpdate(msocket_t *self, uint32_t *elapsed){
+   uint8_t result = 0;
+   self->inactivityMs = msocket_timestamp() - self->lastActivityMs;
+   if(self->inactivityMs >= self->inactivityCallMs){
+      *elapsed = self->inactivityCallMs;
+      self->inactivityCallMs = (self->inactivityMs / TIMEOUT_CALL_INTERVAL_MS + 1) * TIMEOUT_CALL_INTERVAL_MS;
+      result = 1;
+   }
+   return result;
+}
+
+/**
+ * Starts inactivity timer if the handler wants inactivity callbacks. Caller must hold the driver's timer lock.
+ */
+static void msocket_inactivityStart(msocket_t *self){
+   if( (self->timerWheel != 0) && ( (self->handlerTable->tcp_inactivity != 0) || (self->handlerTable->tcp_idle != 0) ) ){
+      //expiry time is corrected by msocket_inactivityTimeout, no need to be exact here
+      msocket_timerwheel_add(self->timerWheel, &self->inactivityTimer, msocket_timestamp() + TIMEOUT_CALL_INTERVAL_MS, &self->timers);
+   }
+}
+
+/**
+ * Inactivity timer expired. Sends and receives only update lastActivityMs, the timer is moved forward here instead.
+ */
+static void msocket_inactivityTimeout(msocket_t *self){
+   uint8_t inactivity_timeout;
+   uint32_t elapsed = 0;
+   uint32_t expires;
+   MUTEX_LOCK(self->mutex);
+   if(self->state != MSOCKET_STATE_ESTABLISHED){
+      MUTEX_UNLOCK(self->mutex);
+      return; //listening sockets have no inactivity
+   }
+   inactivity_timeout = msocket_timeoutUpdate(self, &elapsed);
+   expires = self->lastActivityMs + self->inactivityCallMs;
+   MUTEX_UNLOCK(self->mutex);
+   if(inactivity_timeout != 0){
+      if(self->handlerTable->tcp_inactivity != 0){
+         self->handlerTable->tcp_inactivity(elapsed);
       }
-#else
-      int rc = THREAD_CREATE(self->ioThread,ioTask,self);
-      if(rc != 0){
-         return -1;
+      if(self->handlerTable->tcp_idle != 0){
+         self->handlerTable->tcp_idle(self->handlerArg, elapsed);
       }
+   }
+   msocket_timerLock(self);
+   if( (self->timerWheel != 0) && (msocket_timer_is_running(&self->inactivityTimer) == 0) ){
+      msocket_timerwheel_add(self->timerWheel, &self->inactivityTimer, expires, &self->timers);
+   }
+   msocket_timerUnlock(self);
+}
+
+/**
+ * Socket of msocket_connect_async became writable (or reported an error). Called by the I/O driver.
+ */
+static int msocket_connectComplete(msocket_t *self){
+   int error = 0;
+   SOCK_LEN_T len = (SOCK_LEN_T) sizeof(error);
+   uint8_t state;
+   if(getsockopt(self->tcpsockfd, SOL_SOCKET, SO_ERROR, (char*) &error, &len) < 0){
+      error = errno;
+   }
+   if(error != 0){
+      return msocket_connectFailed(self, error);
+   }
+#ifdef _WIN32
+   msocket_setBlocking(self->tcpsockfd);
 #endif
-      self->threadRunning = 1;
-      return 0;
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   if(state == MSOCKET_STATE_PENDING){
+      self->state = MSOCKET_STATE_ESTABLISHED;
+      msocket_timeoutReset(self);
    }
-   errno = EINVAL;
-   return -1;
+   MUTEX_UNLOCK(self->mutex);
+   if(state != MSOCKET_STATE_PENDING){
+      return -1; //msocket_close was called while connecting
+   }
+   msocket_timerLock(self);
+   if(self->timerWheel != 0){
+      msocket_timerwheel_remove(self->timerWheel, &self->connectTimer);
+      msocket_inactivityStart(self);
+   }
+   msocket_timerUnlock(self);
+   if(self->handlerTable->tcp_connected != 0){
+      self->handlerTable->tcp_connected(self->handlerArg, &self->tcpInfo.addr[0], self->tcpInfo.port);
+   }
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   MUTEX_UNLOCK(self->mutex);
+   return (state == MSOCKET_STATE_CLOSING)? -1 : 0;
 }
 
-static int msocket_udpRxHandler(msocket_t *self,uint8_t *recvBuf, int len){
-   if((self != 0) && (len > 0) && (self->handlerTable->udp_msg != 0)){
-      self->handlerTable->udp_msg(self->handlerArg,&self->udpInfo.addr[0],self->udpInfo.port,recvBuf,(uint32_t) len);
-      return 0;
+/**
+ * Ends a connection attempt of msocket_connect_async with error (errno value)
+ */
+static int msocket_connectFailed(msocket_t *self, int error){
+   uint8_t state;
+   MUTEX_LOCK(self->mutex);
+   state = self->state;
+   if(state == MSOCKET_STATE_PENDING){
+      self->state = MSOCKET_STATE_CLOSING;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if( (state == MSOCKET_STATE_PENDING) && (self->handlerTable->tcp_connect_failed != 0) ){
+      self->handlerTable->tcp_connect_failed(self->handlerArg, error);
    }
    return -1;
 }
 
-static int msocket_tcpRxHandler(msocket_t *self,uint8_t *recvBuf, int len){
-   if( len < 0 ){
+/**
+ * Returns 1 when a failed call to connect on a non-blocking socket means that the connection attempt is in progress
+ */
+static uint8_t msocket_connectInProgress(void){
 #ifdef _WIN32
-      int lastError = WSAGetLastError();
-      if (lastError == WSAECONNRESET)
-      {
-         len = 0; //change to socket closed event
-      }
-      else
-      {
-#if(MSOCKET_DEBUG)
-         fprintf(stderr, "[MSOCKET] recv error %d\n", lastError);
-#endif
-         return -1;
-      }
+   return (WSAGetLastError() == WSAEWOULDBLOCK)? 1u : 0u;
 #else
-      if(errno == ECONNRESET){
-         len = 0; //change to socket closed event
-      }
-      else{
-#if(MSOCKET_DEBUG)
-         perror("msocket: recv error");
+   return (errno == EINPROGRESS)? 1u : 0u;
 #endif
-         return -1;
-      }
+}
+
+/**
+ * Timers are protected by the lock of the I/O driver: the reactor mutex or, for sockets with their own ioThread, the socket mutex.
+ */
+static void msocket_timerLock(msocket_t *self){
+#ifdef __linux__
+   if(self->reactor != 0){
+      msocket_reactor_lock(self->reactor);
+      return;
+   }
 #endif
+   MUTEX_LOCK(self->mutex);
+}
+
+static void msocket_timerUnlock(msocket_t *self){
+#ifdef __linux__
+   if(self->reactor != 0){
+      msocket_reactor_unlock(self->reactor);
+      return;
    }
-   if( self != 0 ){
-      if( len == 0 ){
-         int8_t triggerCallback = 1u;
-         MUTEX_LOCK(self->mutex);
-         if (self->state == MSOCKET_STATE_CLOSING) {
-            triggerCallback = 0;
-         }
-         self->state = MSOCKET_STATE_CLOSING;
-         MUTEX_UNLOCK(self->mutex);
-         if( (triggerCallback != 0) && (self->handlerTable->tcp_disconnected != 0) ){
-            self->handlerTable->tcp_disconnected(self->handlerArg);
-         }
-         return -1;
-      }
-      else if(self->handlerTable->tcp_data != 0){
-         if(msocket_bytearray_append(&self->tcpRxBuf,recvBuf,(uint32_t) len) != 0){
-            return -1;
-         }
-         while(1){
-            //message parse loop
-            int8_t rc;
-            uint32_t parseLen = 0;
-            uint32_t u32Len;
-            const uint8_t *pBegin = (const uint8_t*) self->tcpRxBuf.pData;
-            u32Len = self->tcpRxBuf.u32CurLen;
-            if(u32Len == 0){
-               break; //no more data
-            }
-            rc = self->handlerTable->tcp_data(self->handlerArg, pBegin, u32Len, &parseLen);
-            if( rc != 0 ){
-               MUTEX_LOCK(self->mutex);
-               self->state = MSOCKET_STATE_CLOSING;
-               MUTEX_UNLOCK(self->mutex);
-               break;
-            }
-            if(parseLen == 0){
-               break;
-            }
-            else{
-               assert(parseLen<=u32Len);
-               msocket_bytearray_trimLeft(&self->tcpRxBuf,pBegin+parseLen);
-            }
-         }
-      }
+#endif
+   MUTEX_UNLOCK(self->mutex);
+}
+
+/**
+ * Makes the I/O driver re-evaluate its next timeout
+ */
+static void msocket_timerNotify(msocket_t *self){
+#ifdef __linux__
+   if(self->reactor != 0){
+      msocket_reactor_notify(self->reactor);
+      return;
+   }
+#endif
+#ifndef _WIN32
+   if(msocket_isIoThread(self) == 0){
+      MUTEX_LOCK(self->mutex);
+      msocket_wakeupSignal(self);
+      MUTEX_UNLOCK(self->mutex);
+   }
+#endif
+}
+
+/**
+ * Monotonic time in milliseconds, wraps around after 49 days
+ */
+uint32_t msocket_timestamp(void){
+#ifdef _WIN32
+   return (uint32_t) GetTickCount();
+#else
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint32_t) ( ((uint64_t) now.tv_sec * 1000u) + ((uint64_t) now.tv_nsec / 1000000u) );
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * Creates the file descriptor(s) used by msocket_close to interrupt poll in ioTask
+ */
+static int8_t msocket_wakeupOpen(msocket_t *self){
+#ifdef __linux__
+   int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if(fd < 0){
+      return -1;
+   }
+   self->wakeupfd[0] = fd;
+   self->wakeupfd[1] = fd;
+#else
+   if(pipe(self->wakeupfd) < 0){
+      return -1;
    }
+   fcntl(self->wakeupfd[0], F_SETFL, O_NONBLOCK);
+   fcntl(self->wakeupfd[1], F_SETFL, O_NONBLOCK);
+#endif
    return 0;
 }
 
-void msocket_timeoutReset(msocket_t *self){
-   if(self != 0){
-      self->inactivityMs=0;
-      self->inactivityCallMs=TIMEOUT_CALL_INTERVAL_MS;
+static void msocket_wakeupClose(msocket_t *self){
+   if(self->wakeupfd[1] != self->wakeupfd[0]){
+      close(self->wakeupfd[1]);
+   }
+   if(self->wakeupfd[0] >= 0){
+      close(self->wakeupfd[0]);
    }
+   self->wakeupfd[0] = -1;
+   self->wakeupfd[1] = -1;
 }
 
-uint8_t msocket_timeoutIncrease(msocket_t *self){
-   if(self != 0){
-      self->inactivityMs+=TIMEOUT_MS;
-      if(self->inactivityMs==self->inactivityCallMs){
-         self->inactivityCallMs+=TIMEOUT_CALL_INTERVAL_MS;
-         return 1;
-      }
+static void msocket_wakeupSignal(msocket_t *self){
+   if(self->wakeupfd[1] >= 0){
+#ifdef __linux__
+      uint64_t value = 1u;
+#else
+      uint8_t value = 1u;
+#endif
+      ssize_t result = write(self->wakeupfd[1], &value, sizeof(value));
+      (void) result;
    }
-   return 0;
 }
 
-static void msocket_joinIoThread(msocket_t *self){
+static void msocket_wakeupDrain(msocket_t *self){
+   uint64_t value;
+   while(read(self->wakeupfd[0], &value, sizeof(value)) > 0){}
+}
+#endif
+
+static int8_t msocket_joinIoThread(msocket_t *self){
+#ifdef __linux__
+   if (self->reactor != 0){
+      //msocket_reactor_detach resets threadRunning
+      return msocket_reactor_detach(self->reactor, self);
+   }
+#endif
 #ifdef _WIN32
    DWORD result = WaitForSingleObject(self->ioThread, 1000);
    if (result == WAIT_OBJECT_0){
@@ -850,6 +3426,7 @@ static void msocket_joinIoThread(msocket_t *self){
    if (s == 0){
       MUTEX_LOCK(self->mutex);
       self->threadRunning = 0;
+      msocket_wakeupClose(self);
       MUTEX_UNLOCK(self->mutex);
    }
 # if(MSOCKET_DEBUG)
@@ -858,6 +3435,34 @@ static void msocket_joinIoThread(msocket_t *self){
    }
 # endif
 #endif
+   return 0;
+}
+
+static uint8_t msocket_isIoThread(msocket_t *self){
+   if (self->reactor != 0){
+      return 0u; //reactor keeps track of this itself, see msocket_reactor_detach
+   }
+#ifdef _WIN32
+   if ( (unsigned int) GetCurrentThreadId() == self->ioThreadId ){
+      return 1u;
+   }
+#else
+   if (pthread_equal(pthread_self(), self->ioThread) != 0){
+      return 1u;
+   }
+#endif
+   return 0u;
+}
+
+/**
+ * Returns 1 when the socket is established and served by an I/O driver, both read under the socket mutex.
+ */
+static uint8_t msocket_isServedEstablished(msocket_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = ( (self->threadRunning != 0) && (self->state == MSOCKET_STATE_ESTABLISHED) )? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
 }
 
 static void msocket_closeInternalSocket(msocket_t *self, uint8_t socketMode){
@@ -878,21 +3483,73 @@ static void msocket_reset(msocket_t *self){
    self->newConnection = 0u;
    self->socketMode = 0u;
    msocket_timeoutReset(self);
-   msocket_bytearray_clear(&self->tcpRxBuf);
+   msocket_bytequeue_clear(&self->tcpRxBuf);
+   self->rxSize = self->rxSizeMin;
+   self->rxBusy = 0u;
+   self->rxBacklog = 0u;
+   self->rxPaused = 0u;
+   self->rxResumed = 0u;
+   self->rxQueued = 0u;
+   msocket_framer_reset(&self->framer);
+   msocket_txClear(self);
+   self->txSending = 0u; //items of a send still in flight belong to the detached reactor handle
+#ifdef __linux__
+   msocket_zcClear(self);
+   self->zcThreshold = 0u;
+   self->zcNextId = 0u;
+#endif
+#ifndef _WIN32
+   self->workFailed = 0u;
+   self->workDisconnected = 0u;
+#endif
 }
 
 static void msocket_shutdownPrepare(msocket_t *self){
-    if( (self->state == MSOCKET_STATE_PENDING) || (self->state == MSOCKET_STATE_ESTABLISHED) || (self->state == MSOCKET_STATE_ACCEPTING) ){
+    if( (self->state == MSOCKET_STATE_PENDING) || (self->state == MSOCKET_STATE_ESTABLISHED) || (self->state == MSOCKET_STATE_ACCEPTING) ||
+        ( ( (self->state == MSOCKET_STATE_LISTENING) || (self->socketMode & MSOCKET_MODE_UDP) ) && (self->threadRunning != 0) ) ){
        self->state = MSOCKET_STATE_CLOSING;
        if (self->socketMode & MSOCKET_MODE_TCP){
           SOCKET_SHUTDOWN(self->tcpsockfd);
        }
+#ifndef _WIN32
+       msocket_wakeupSignal(self);
+#endif
    }
 }
 
+/**
+ * On Linux accept4 creates the socket with FD_CLOEXEC already set, saving a separate fcntl call.
+ */
+static SOCKET_T msocket_acceptSocket(SOCKET_T sockfd, struct sockaddr *addr, SOCK_LEN_T *addrLen){
+#ifdef __linux__
+   return accept4(sockfd, addr, addrLen, SOCK_CLOEXEC);
+#else
+   return accept(sockfd, addr, addrLen);
+#endif
+}
+
+static void msocket_setNonBlocking(SOCKET_T sockfd){
+#ifdef _WIN32
+   u_long mode = 1;
+   ioctlsocket(sockfd, FIONBIO, &mode);
+#else
+   int flags = fcntl(sockfd, F_GETFL, 0);
+   if (flags >= 0){
+      fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+   }
+#endif
+}
+
+#ifdef _WIN32
+static void msocket_setBlocking(SOCKET_T sockfd){
+   u_long mode = 0;
+   ioctlsocket(sockfd, FIONBIO, &mode);
+}
+#endif
+
 #ifndef _WIN32
 static int msocket_accept_local(msocket_t* self, msocket_t* child) {
-   SOCKET_T sockfd = accept(self->tcpsockfd, NULL, NULL);
+   SOCKET_T sockfd = msocket_acceptSocket(self->tcpsockfd, NULL, NULL);
    if (IS_INVALID_SOCKET(sockfd)) {
       return -1;
    }
@@ -912,15 +3569,14 @@ static int msocket_accept_inet(msocket_t* self, msocket_t* child) {
 
    cli_len = sizeof(cli_addr);
    memset(&cli_addr, 0, cli_len);
-   sockfd = accept(self->tcpsockfd, (struct sockaddr*)&cli_addr, &cli_len); //blocking call (close tcpsockfd from another thread to unblock)
+   sockfd = msocket_acceptSocket(self->tcpsockfd, (struct sockaddr*)&cli_addr, &cli_len); //blocking call (close tcpsockfd from another thread to unblock)
    if (IS_INVALID_SOCKET(sockfd)) {
       return -1;
    }
-   if (inet_ntop(AF_INET, &(cli_addr.sin_addr), child->tcpInfo.addr, MSOCKET_ADDRSTRLEN) == NULL) {
+   if (msocket_setPeerAddress(child, (const struct sockaddr*) &cli_addr) < 0) {
       SOCKET_CLOSE(sockfd);
       return -1;
    }
-   child->tcpInfo.port = ntohs(cli_addr.sin_port);
    child->tcpsockfd = sockfd;
    return 0;
 }
@@ -936,21 +3592,82 @@ static int msocket_accept_inet6(msocket_t* self, msocket_t* child) {
 
    cli_len = sizeof(cli_addr6);
    memset(&cli_addr6, 0, cli_len);
-   sockfd = accept(self->tcpsockfd, (struct sockaddr*) &cli_addr6, &cli_len);
+   sockfd = msocket_acceptSocket(self->tcpsockfd, (struct sockaddr*) &cli_addr6, &cli_len);
    if (IS_INVALID_SOCKET(sockfd)) {
       return -1;
    }
-   if (inet_ntop(AF_INET, &(cli_addr6.sin6_addr), child->tcpInfo.addr, MSOCKET_ADDRSTRLEN) == NULL) {
+   if (msocket_setPeerAddress(child, (const struct sockaddr*) &cli_addr6) < 0) {
       SOCKET_CLOSE(sockfd);
       return -1;
    }
-   child->tcpInfo.port = ntohs(cli_addr6.sin6_port);
    child->tcpsockfd = sockfd;
    return 0;
 }
 
+/**
+ * Saves address and port of remote peer in child->tcpInfo
+ */
+static int msocket_setPeerAddress(msocket_t *child, const struct sockaddr *addr) {
+   if (addr->sa_family == AF_INET) {
+      const struct sockaddr_in *addr4 = (const struct sockaddr_in*) addr;
+      if (inet_ntop(AF_INET, &(addr4->sin_addr), child->tcpInfo.addr, MSOCKET_ADDRSTRLEN) == NULL) {
+         return -1;
+      }
+      child->tcpInfo.port = ntohs(addr4->sin_port);
+   }
+   else if (addr->sa_family == AF_INET6) {
+      const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6*) addr;
+      if (inet_ntop(AF_INET6, &(addr6->sin6_addr), child->tcpInfo.addr, MSOCKET_ADDRSTRLEN) == NULL) {
+         return -1;
+      }
+      child->tcpInfo.port = ntohs(addr6->sin6_port);
+   }
+   return 0;
+}
+
+/**
+ * Fills in destination address of a UDP datagram, returns length of the address
+ */
+static SOCK_LEN_T msocket_udpAddress(msocket_t *self, const char *addr, uint16_t port, struct sockaddr_storage *saddr) {
+   memset(saddr, 0, sizeof(*saddr));
+   if (self->addressFamily == AF_INET6) {
+      struct sockaddr_in6 *saddr6 = (struct sockaddr_in6*) saddr;
+      saddr6->sin6_family = AF_INET6;
+      saddr6->sin6_port = htons(port);
+      inet_pton(AF_INET6, addr, &(saddr6->sin6_addr));
+      return (SOCK_LEN_T) sizeof(struct sockaddr_in6);
+   }
+   else {
+      struct sockaddr_in *saddr4 = (struct sockaddr_in*) saddr;
+      saddr4->sin_family = AF_INET;
+      saddr4->sin_port = htons(port);
+      inet_pton(AF_INET, addr, &(saddr4->sin_addr));
+      return (SOCK_LEN_T) sizeof(struct sockaddr_in);
+   }
+}
+
+/**
+ * Applies socket options of a newly accepted connection, all in one place.
+ */
+static void msocket_acceptComplete(msocket_t *child) {
+   if ( (child->addressFamily == AF_INET) || (child->addressFamily == AF_INET6) ) {
+      int sockoptval = 1;
+      socklen_t sockoptlen = sizeof(sockoptval);
+      setsockopt(child->tcpsockfd, IPPROTO_TCP, TCP_NODELAY, (const char*)&sockoptval, sockoptlen);
+   }
+
+   MUTEX_LOCK(child->mutex);
+   child->state = MSOCKET_STATE_ESTABLISHED;
+   child->socketMode = MSOCKET_MODE_TCP;
+   child->newConnection = 1;
+   MUTEX_UNLOCK(child->mutex);
+}
+
 
-static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t port) {
+/**
+ * When async is set the socket is made non-blocking and a connection attempt still in progress counts as success.
+ */
+static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t port, uint8_t async) {
    struct sockaddr_in saddr;
    int result;
    SOCKET_T sockfd;
@@ -974,8 +3691,11 @@ static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t p
    if (IS_INVALID_SOCKET(sockfd)) {
       return -1;
    }
+   if (async != 0u) {
+      msocket_setNonBlocking(sockfd);
+   }
    result = connect(sockfd, (struct sockaddr*)&saddr, sizeof(saddr));
-   if (result < 0) {
+   if ( (result < 0) && ( (async == 0u) || (msocket_connectInProgress() == 0u) ) ) {
       SOCKET_CLOSE(sockfd);
       return -1;
    }
@@ -984,7 +3704,7 @@ static int msocket_connect_inet(msocket_t* self, const char* address, uint16_t p
    return 0;
 }
 
-static int msocket_connect_inet6(msocket_t* self, const char* address, uint16_t port)
+static int msocket_connect_inet6(msocket_t* self, const char* address, uint16_t port, uint8_t async)
 {
    struct sockaddr_in6 saddr6;
    int result;
@@ -1010,8 +3730,11 @@ static int msocket_connect_inet6(msocket_t* self, const char* address, uint16_t
    if (IS_INVALID_SOCKET(sockfd)) {
       return -1;
    }
+   if (async != 0u) {
+      msocket_setNonBlocking(sockfd);
+   }
    result = connect(sockfd, (struct sockaddr*)&saddr6, sizeof(saddr6));
-   if (result < 0) {
+   if ( (result < 0) && ( (async == 0u) || (msocket_connectInProgress() == 0u) ) ) {
       SOCKET_CLOSE(sockfd);
       return -1;
    }
@@ -11,10 +11,17 @@
 //////////////////////////////////////////////////////////////////////////////
 // INCLUDES
 //////////////////////////////////////////////////////////////////////////////
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE //memfd_create
+#endif
 #include "msocket_adt.h"
 #include <malloc.h>
 #include <string.h>
 #include <assert.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////////////
 // CONSTANTS AND DATA TYPES
@@ -25,6 +32,7 @@
 // LOCAL FUNCTION PROTOTYPES
 //////////////////////////////////////////////////////////////////////////////
 static msocket_adt_error_t msocket_bytearray_realloc(msocket_bytearray_t *self, uint32_t u32NewLen);
+static void msocket_bytequeue_compact(msocket_bytequeue_t *self);
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -38,6 +46,9 @@ static msocket_adt_error_t msocket_bytearray_realloc(msocket_bytearray_t *self,
 
 /*** msocket_bytearray API ***/
 
+/**
+ * u32GrowSize is the smallest step the allocation grows by, see msocket_bytearray_grow
+ */
 void msocket_bytearray_create(msocket_bytearray_t *self,uint32_t u32GrowSize){
    if(self){
       self->pData = 0;
@@ -124,26 +135,35 @@ msocket_adt_error_t msocket_bytearray_trimLeft(msocket_bytearray_t *self, const
          memmove(self->pData,pSrc,remain);
          self->u32CurLen = remain;
       }
+      if( (self->u32AllocLen > MSOCKET_BYTEARRAY_SHRINK_SIZE) && (self->u32CurLen <= self->u32AllocLen / 4u) ){
+         //a large transient message has been consumed, give the memory back
+         (void) msocket_bytearray_shrink(self, (self->u32CurLen > self->u32GrowSize)? self->u32CurLen : self->u32GrowSize);
+      }
       return ADT_NO_ERROR;
    }
    return ADT_INVALID_ARGUMENT_ERROR;
 }
 
 /**
- * grows byte array by a predefined size
+ * Grows byte array to at least u32MinLen bytes. The allocation grows geometrically, by its current size but at least
+ * u32GrowSize and at most MSOCKET_BYTEARRAY_MAX_GROW_SIZE per step, so a large message only takes a few reallocations.
+ * With u32GrowSize=0 it grows to exactly u32MinLen.
  */
 msocket_adt_error_t msocket_bytearray_grow(msocket_bytearray_t *self, uint32_t u32MinLen){
    if( self != 0 ){
       if (u32MinLen > self->u32AllocLen) {
-         uint32_t u32NewLen = self->u32AllocLen;
+         uint32_t u32NewLen = u32MinLen;
          if (self->u32GrowSize > 0){
-            while(u32NewLen<u32MinLen){
-               u32NewLen += self->u32GrowSize;
+            uint32_t u32Step = self->u32AllocLen;
+            if (u32Step < self->u32GrowSize){
+               u32Step = self->u32GrowSize;
+            }
+            else if (u32Step > MSOCKET_BYTEARRAY_MAX_GROW_SIZE){
+               u32Step = MSOCKET_BYTEARRAY_MAX_GROW_SIZE;
+            }
+            if ( (self->u32AllocLen <= UINT32_MAX - u32Step) && (self->u32AllocLen + u32Step > u32MinLen) ){
+               u32NewLen = self->u32AllocLen + u32Step;
             }
-         }
-         else
-         {
-            u32NewLen = u32MinLen;
          }
          return msocket_bytearray_realloc(self, u32NewLen);
       }
@@ -152,6 +172,27 @@ msocket_adt_error_t msocket_bytearray_grow(msocket_bytearray_t *self, uint32_t u
    return ADT_INVALID_ARGUMENT_ERROR;
 }
 
+/**
+ * Releases allocated memory beyond u32MaxFree unused bytes, u32MaxFree=0 shrinks the allocation to fit the data.
+ */
+msocket_adt_error_t msocket_bytearray_shrink(msocket_bytearray_t *self, uint32_t u32MaxFree){
+   if( self != 0 ){
+      uint32_t u32NewLen;
+      if (self->u32AllocLen - self->u32CurLen <= u32MaxFree){
+         return ADT_NO_ERROR;
+      }
+      u32NewLen = self->u32CurLen + u32MaxFree;
+      if (u32NewLen == 0){
+         free(self->pData);
+         self->pData = 0;
+         self->u32AllocLen = 0;
+         return ADT_NO_ERROR;
+      }
+      return msocket_bytearray_realloc(self, u32NewLen);
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
 uint8_t *msocket_bytearray_data(const msocket_bytearray_t *self){
    if(self != 0){
       return self->pData;
@@ -172,6 +213,292 @@ void msocket_bytearray_clear(msocket_bytearray_t *self){
    }
 }
 
+/*** msocket_bytequeue API ***/
+
+/**
+ * u32GrowSize is the smallest step the buffer grows by (see msocket_bytearray_grow),
+ * u32GrowSize=0 makes the buffer double its size whenever it needs to grow
+ */
+void msocket_bytequeue_create(msocket_bytequeue_t *self, uint32_t u32GrowSize){
+   if(self != 0){
+      self->pData = 0;
+      self->u32ReadPos = 0;
+      self->u32WritePos = 0;
+      self->u32AllocLen = 0;
+      self->isRing = false;
+      if (u32GrowSize > MSOCKET_BYTEARRAY_MAX_GROW_SIZE) {
+         self->u32GrowSize = MSOCKET_BYTEARRAY_MAX_GROW_SIZE;
+      }
+      else {
+         self->u32GrowSize = u32GrowSize;
+      }
+   }
+}
+
+/**
+ * Creates a fixed size ring buffer. u32Size is rounded up to a multiple of the page size.
+ * The same memfd is mapped twice back to back so a view that wraps around the end of the ring is contiguous in memory.
+ * Returns ADT_MEM_ERROR with errno set when the memory could not be mapped.
+ */
+msocket_adt_error_t msocket_bytequeue_createRing(msocket_bytequeue_t *self, uint32_t u32Size){
+#ifdef __linux__
+   if( (self != 0) && (u32Size > 0) && (u32Size <= MSOCKET_BYTEQUEUE_MAX_RING_SIZE) ){
+      uint8_t *pBase;
+      int fd;
+      uint32_t u32PageSize = (uint32_t) sysconf(_SC_PAGESIZE);
+      u32Size = (u32Size + u32PageSize - 1u) & ~(u32PageSize - 1u);
+      fd = memfd_create("msocket_ring", MFD_CLOEXEC);
+      if(fd < 0){
+         return ADT_MEM_ERROR;
+      }
+      if(ftruncate(fd, (off_t) u32Size) != 0){
+         close(fd);
+         return ADT_MEM_ERROR;
+      }
+      //reserve address space for both mappings, then map the file into each half
+      pBase = (uint8_t*) mmap(0, (size_t) u32Size * 2u, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(pBase == MAP_FAILED){
+         close(fd);
+         return ADT_MEM_ERROR;
+      }
+      if( (mmap(pBase, u32Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+          (mmap(pBase + u32Size, u32Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ){
+         munmap(pBase, (size_t) u32Size * 2u);
+         close(fd);
+         return ADT_MEM_ERROR;
+      }
+      close(fd); //the mappings keep the memory alive
+      self->pData = pBase;
+      self->u32ReadPos = 0;
+      self->u32WritePos = 0;
+      self->u32AllocLen = u32Size;
+      self->u32GrowSize = 0;
+      self->isRing = true;
+      return ADT_NO_ERROR;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+#else
+   (void) self;
+   (void) u32Size;
+   return ADT_NOT_IMPLEMENTED_ERROR;
+#endif
+}
+
+void msocket_bytequeue_destroy(msocket_bytequeue_t *self){
+   if( (self != 0) && (self->pData != 0) ){
+#ifdef __linux__
+      if(self->isRing){
+         munmap(self->pData, (size_t) self->u32AllocLen * 2u);
+      }
+      else
+#endif
+      {
+         free(self->pData);
+      }
+      self->pData = 0;
+      self->u32AllocLen = 0;
+   }
+}
+
+/**
+ * Makes sure at least u32MinFree unused bytes follow the data so they can be written in place (e.g. by recv).
+ * Compacts the queue first and only grows the buffer when that is not enough.
+ */
+msocket_adt_error_t msocket_bytequeue_reserveTail(msocket_bytequeue_t *self, uint32_t u32MinFree){
+   if(self != 0){
+      uint32_t u32MinLen;
+      if(msocket_bytequeue_tailLength(self) >= u32MinFree){
+         return ADT_NO_ERROR;
+      }
+      if(self->isRing){
+         return ADT_LENGTH_ERROR; //the ring does not grow
+      }
+      msocket_bytequeue_compact(self);
+      if(u32MinFree > UINT32_MAX - self->u32WritePos){
+         return ADT_ARRAY_TOO_LARGE_ERROR;
+      }
+      u32MinLen = self->u32WritePos + u32MinFree;
+      if(u32MinLen > self->u32AllocLen){
+         uint8_t *pNewData;
+         uint32_t u32NewLen = self->u32AllocLen;
+         if(self->u32GrowSize > 0){
+            //same bounded geometric step as msocket_bytearray_grow
+            uint32_t u32Step = self->u32AllocLen;
+            if(u32Step < self->u32GrowSize){
+               u32Step = self->u32GrowSize;
+            }
+            else if(u32Step > MSOCKET_BYTEARRAY_MAX_GROW_SIZE){
+               u32Step = MSOCKET_BYTEARRAY_MAX_GROW_SIZE;
+            }
+            if( (u32NewLen <= UINT32_MAX - u32Step) && (u32NewLen + u32Step > u32MinLen) ){
+               u32NewLen += u32Step;
+            }
+            else{
+               u32NewLen = u32MinLen;
+            }
+         }
+         else{
+            //no grow size, double the allocation to keep the number of reallocations low
+            u32NewLen = (u32NewLen > UINT32_MAX / 2u)? UINT32_MAX : u32NewLen * 2u;
+            if(u32NewLen < u32MinLen){
+               u32NewLen = u32MinLen;
+            }
+         }
+         pNewData = (uint8_t*) realloc(self->pData, u32NewLen);
+         if(pNewData == 0){
+            return ADT_MEM_ERROR;
+         }
+         self->pData = pNewData;
+         self->u32AllocLen = u32NewLen;
+      }
+      return ADT_NO_ERROR;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
+/**
+ * Releases memory so that at most u32MaxFree unused bytes remain after the data. Has no effect on a ring buffer.
+ */
+msocket_adt_error_t msocket_bytequeue_shrink(msocket_bytequeue_t *self, uint32_t u32MaxFree){
+   if(self != 0){
+      uint32_t u32NewLen;
+      if( (self->isRing) || (self->u32AllocLen - (self->u32WritePos - self->u32ReadPos) <= u32MaxFree) ){
+         return ADT_NO_ERROR;
+      }
+      msocket_bytequeue_compact(self);
+      u32NewLen = self->u32WritePos + u32MaxFree;
+      if(u32NewLen == 0){
+         free(self->pData);
+         self->pData = 0;
+      }
+      else{
+         uint8_t *pNewData = (uint8_t*) realloc(self->pData, u32NewLen);
+         if(pNewData == 0){
+            return ADT_MEM_ERROR;
+         }
+         self->pData = pNewData;
+      }
+      self->u32AllocLen = u32NewLen;
+      return ADT_NO_ERROR;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
+/**
+ * Returns pointer to the first unused byte after the data
+ */
+uint8_t *msocket_bytequeue_tail(const msocket_bytequeue_t *self){
+   if( (self != 0) && (self->pData != 0) ){
+      return self->pData + self->u32WritePos;
+   }
+   return 0;
+}
+
+/**
+ * Returns number of unused bytes after the data
+ */
+uint32_t msocket_bytequeue_tailLength(const msocket_bytequeue_t *self){
+   if(self != 0){
+      if(self->isRing){
+         return self->u32AllocLen - (self->u32WritePos - self->u32ReadPos);
+      }
+      return self->u32AllocLen - self->u32WritePos;
+   }
+   return 0;
+}
+
+/**
+ * Adds u32DataLen bytes that were written directly into the tail to the end of the queue
+ */
+msocket_adt_error_t msocket_bytequeue_commit(msocket_bytequeue_t *self, uint32_t u32DataLen){
+   if( (self != 0) && (u32DataLen <= msocket_bytequeue_tailLength(self)) ){
+      self->u32WritePos += u32DataLen;
+      return ADT_NO_ERROR;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
+msocket_adt_error_t msocket_bytequeue_append(msocket_bytequeue_t *self, const uint8_t *pData, uint32_t u32DataLen){
+   if( (self != 0) && (pData != 0) && (u32DataLen > 0) ){
+      msocket_adt_error_t errorCode = msocket_bytequeue_reserveTail(self, u32DataLen);
+      if(errorCode == ADT_NO_ERROR){
+         memcpy(self->pData + self->u32WritePos, pData, u32DataLen);
+         self->u32WritePos += u32DataLen;
+      }
+      return errorCode;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
+/**
+ * Removes u32DataLen bytes from the front of the queue. Only moves the read cursor, no data is copied.
+ */
+msocket_adt_error_t msocket_bytequeue_consume(msocket_bytequeue_t *self, uint32_t u32DataLen){
+   if( (self != 0) && (u32DataLen <= self->u32WritePos - self->u32ReadPos) ){
+      self->u32ReadPos += u32DataLen;
+      if(self->u32ReadPos == self->u32WritePos){
+         self->u32ReadPos = 0;
+         self->u32WritePos = 0;
+      }
+      else if( (self->isRing) && (self->u32ReadPos >= self->u32AllocLen) ){
+         //cursor entered the second mapping, move both positions back into the first
+         self->u32ReadPos -= self->u32AllocLen;
+         self->u32WritePos -= self->u32AllocLen;
+      }
+      return ADT_NO_ERROR;
+   }
+   return ADT_INVALID_ARGUMENT_ERROR;
+}
+
+uint8_t *msocket_bytequeue_data(const msocket_bytequeue_t *self){
+   if( (self != 0) && (self->pData != 0) ){
+      return self->pData + self->u32ReadPos;
+   }
+   return 0;
+}
+
+uint32_t msocket_bytequeue_length(const msocket_bytequeue_t *self){
+   if(self != 0){
+      return self->u32WritePos - self->u32ReadPos;
+   }
+   return 0;
+}
+
+void msocket_bytequeue_clear(msocket_bytequeue_t *self){
+   if(self != 0){
+      self->u32ReadPos = 0;
+      self->u32WritePos = 0;
+   }
+}
+
+/**
+ * Hands the buffer over to the caller, who becomes responsible for freeing it, and continues in pNewData (allocated with
+ * malloc, u32NewLen bytes). Unconsumed data is copied into the new buffer. pNewData=NULL (or a buffer too small for the
+ * data) lets the queue allocate one. Returns NULL for a ring buffer or when no memory was available, the queue is then unchanged.
+ */
+uint8_t *msocket_bytequeue_swap(msocket_bytequeue_t *self, uint8_t *pNewData, uint32_t u32NewLen){
+   if( (self != 0) && (!self->isRing) && (self->pData != 0) ){
+      msocket_bytequeue_t oldQueue = *self;
+      uint32_t u32DataLen = self->u32WritePos - self->u32ReadPos;
+      if( (pNewData == 0) || (u32NewLen < u32DataLen) ){
+         free(pNewData);
+         pNewData = 0;
+         u32NewLen = 0;
+      }
+      self->pData = pNewData;
+      self->u32AllocLen = u32NewLen;
+      self->u32ReadPos = 0;
+      self->u32WritePos = 0;
+      if( (u32DataLen > 0) && (msocket_bytequeue_append(self, oldQueue.pData + oldQueue.u32ReadPos, u32DataLen) != ADT_NO_ERROR) ){
+         free(self->pData);
+         *self = oldQueue;
+         return 0;
+      }
+      return oldQueue.pData;
+   }
+   return 0;
+}
+
 /*** msocket_ary API ***/
 
 void msocket_ary_create(msocket_ary_t* self, void (*pDestructor)(void*)) {
@@ -281,17 +608,19 @@ msocket_adt_error_t	msocket_ary_extend(msocket_ary_t* self, int32_t s32Len) {
 // LOCAL FUNCTIONS
 //////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Resizes the allocation in place when possible, large blocks are moved by remapping their pages (mremap in glibc)
+ * instead of copying. The old allocation is kept on failure.
+ */
 static msocket_adt_error_t msocket_bytearray_realloc(msocket_bytearray_t *self, uint32_t u32NewLen) {
-   if (self != 0) {
-      uint8_t *pNewData = (uint8_t*) malloc(u32NewLen);
+   if ( (self != 0) && (u32NewLen > 0) ) {
+      uint8_t *pNewData = (uint8_t*) realloc(self->pData, u32NewLen);
       if(pNewData != 0){
-         if(self->pData != 0) {
-            uint32_t u32CopyLen = (u32NewLen < self->u32CurLen)? u32NewLen : self->u32CurLen;
-            memcpy(pNewData, self->pData, u32CopyLen);
-            free(self->pData);
-         }
          self->pData = pNewData;
          self->u32AllocLen = u32NewLen;
+         if(self->u32CurLen > u32NewLen){
+            self->u32CurLen = u32NewLen;
+         }
       }
       else {
          return ADT_MEM_ERROR;
@@ -299,4 +628,16 @@ static msocket_adt_error_t msocket_bytearray_realloc(msocket_bytearray_t *self,
       return ADT_NO_ERROR;
    }
    return ADT_INVALID_ARGUMENT_ERROR;
-}
\ No newline at end of file
+}
+
+/**
+ * Moves unconsumed bytes to the start of the buffer
+ */
+static void msocket_bytequeue_compact(msocket_bytequeue_t *self){
+   if(self->u32ReadPos > 0){
+      uint32_t u32Len = self->u32WritePos - self->u32ReadPos;
+      memmove(self->pData, self->pData + self->u32ReadPos, u32Len);
+      self->u32ReadPos = 0;
+      self->u32WritePos = u32Len;
+   }
+}
@@ -0,0 +1,426 @@
+/*****************************************************************************
+* \file:    msocket_framer.c
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Message framing of received TCP data (used by msocket when tcp_message or tcp_data_batch is set)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+/********************************* Includes **********************************/
+#include <errno.h>
+#include <string.h>
+#include "msocket_framer.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define FRAMER_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#if defined(FRAMER_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMER_AVX2 1 //compiled with target attribute, used when the CPU supports it
+#include <immintrin.h>
+#endif
+
+/**************************** Constants and Types ****************************/
+#define VARINT_MAX_BYTES 5u //enough for a 32-bit value
+
+typedef const uint8_t *(msocket_framer_find_t)(const uint8_t *begin, const uint8_t *end, uint8_t value);
+
+//receives the messages found by the decoders, either one at a time or collected into batches
+typedef struct msocket_framer_sink_tag{
+   msocket_message_cb_t *message;
+   msocket_batch_cb_t *batch;
+   void *arg;
+   uint32_t numFrames;
+   msocket_frame_t frames[MSOCKET_FRAME_BATCH_MAX];
+} msocket_framer_sink_t;
+
+/************************* Local Function Prototypes *************************/
+static int8_t msocket_framer_decodeSink(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink);
+static int8_t msocket_framer_decodeLength(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink);
+static int8_t msocket_framer_lengthHeader(const msocket_length_framing_t *config, const uint8_t *data, uint32_t len, uint32_t *headerLen, uint32_t *value);
+static int8_t msocket_framer_decodeDelimiter(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink);
+static int8_t msocket_framer_put(msocket_framer_sink_t *sink, const uint8_t *data, uint32_t len);
+static int8_t msocket_framer_flush(msocket_framer_sink_t *sink);
+static const uint8_t *msocket_framer_find(const uint8_t *begin, const uint8_t *end, uint8_t value);
+static const uint8_t *msocket_framer_findScalar(const uint8_t *begin, const uint8_t *end, uint8_t value);
+#ifdef FRAMER_SSE2
+static const uint8_t *msocket_framer_findSse2(const uint8_t *begin, const uint8_t *end, uint8_t value);
+static uint32_t msocket_framer_firstBit(uint32_t mask);
+#endif
+#ifdef FRAMER_AVX2
+static const uint8_t *msocket_framer_findAvx2(const uint8_t *begin, const uint8_t *end, uint8_t value);
+#endif
+
+/****************************** Local Variables ******************************/
+static msocket_framer_find_t *m_find = 0; //selected on first use from the instruction sets of the CPU
+
+/***************************** Exported Functions ****************************/
+
+void msocket_framer_create(msocket_framer_t *self){
+   if (self != 0){
+      memset(self, 0, sizeof(msocket_framer_t));
+      self->type = MSOCKET_FRAMER_NONE;
+      self->budget = UINT32_MAX;
+   }
+}
+
+/**
+ * Switches to length-prefixed framing. config=NULL switches framing off.
+ */
+int8_t msocket_framer_set_length(msocket_framer_t *self, const msocket_length_framing_t *config){
+   if (self != 0){
+      if (config == 0){
+         self->type = MSOCKET_FRAMER_NONE;
+      }
+      else if ( (config->headerSize == MSOCKET_LENGTH_VARINT) || (config->headerSize == 1u) ||
+                (config->headerSize == 2u) || (config->headerSize == 4u) ){
+         self->type = MSOCKET_FRAMER_LENGTH;
+         self->length = *config;
+         if (self->length.maxFrameSize == 0u){
+            self->length.maxFrameSize = MSOCKET_FRAME_SIZE_MAX;
+         }
+      }
+      else{
+         errno = EINVAL;
+         return -1;
+      }
+      self->frameRemain = 0u;
+      self->scanPos = 0u;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Switches to delimiter framing. config=NULL switches framing off.
+ */
+int8_t msocket_framer_set_delimiter(msocket_framer_t *self, const msocket_delimiter_framing_t *config){
+   if (self != 0){
+      if (config == 0){
+         self->type = MSOCKET_FRAMER_NONE;
+      }
+      else{
+         self->type = MSOCKET_FRAMER_DELIMITER;
+         self->delimiter = *config;
+         if (self->delimiter.maxFrameSize == 0u){
+            self->delimiter.maxFrameSize = MSOCKET_FRAME_SIZE_MAX;
+         }
+      }
+      self->frameRemain = 0u;
+      self->scanPos = 0u;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Calls callback for each complete message in data, at most budget messages. parseLen is set to the number of bytes consumed.
+ * Returns -1 when the data violates the framing (errno EMSGSIZE or EPROTO) or when callback returned a negative value.
+ * Returns 1 when callback returned a positive value, decoding then stops right after that message.
+ */
+int8_t msocket_framer_decode(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_message_cb_t *callback, void *arg){
+   if ( (self != 0) && (parseLen != 0) && (callback != 0) ){
+      msocket_framer_sink_t sink;
+      sink.message = callback;
+      sink.batch = (msocket_batch_cb_t*) 0;
+      sink.arg = arg;
+      sink.numFrames = 0u;
+      return msocket_framer_decodeSink(self, data, len, parseLen, &sink);
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Same as msocket_framer_decode but collects the complete messages in data and passes them to callback in one call
+ * (one call per MSOCKET_FRAME_BATCH_MAX messages). The frames point into data.
+ */
+int8_t msocket_framer_decode_batch(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_batch_cb_t *callback, void *arg){
+   if ( (self != 0) && (parseLen != 0) && (callback != 0) ){
+      msocket_framer_sink_t sink;
+      int8_t result;
+      int8_t flushResult;
+      int errorCode;
+      sink.message = (msocket_message_cb_t*) 0;
+      sink.batch = callback;
+      sink.arg = arg;
+      sink.numFrames = 0u;
+      result = msocket_framer_decodeSink(self, data, len, parseLen, &sink);
+      errorCode = errno;
+      flushResult = msocket_framer_flush(&sink); //messages ahead of a framing error are still delivered
+      if (flushResult < 0){
+         return -1;
+      }
+      if (result < 0){
+         errno = errorCode;
+         return -1;
+      }
+      return ( (result > 0) || (flushResult > 0) )? 1 : 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Returns how many more bytes complete the frame that msocket_framer_decode stopped at, 0 when not known.
+ * Lets the caller reserve room for the whole frame before receiving it.
+ */
+uint32_t msocket_framer_remain(const msocket_framer_t *self){
+   return (self != 0)? self->frameRemain : 0u;
+}
+
+void msocket_framer_reset(msocket_framer_t *self){
+   if (self != 0){
+      self->frameRemain = 0u;
+      self->scanPos = 0u;
+   }
+}
+
+/****************************** Local Functions ******************************/
+
+static int8_t msocket_framer_decodeSink(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink){
+   *parseLen = 0u;
+   if (self->type == MSOCKET_FRAMER_LENGTH){
+      return msocket_framer_decodeLength(self, data, len, parseLen, sink);
+   }
+   else if (self->type == MSOCKET_FRAMER_DELIMITER){
+      return msocket_framer_decodeDelimiter(self, data, len, parseLen, sink);
+   }
+   return 0;
+}
+
+static int8_t msocket_framer_decodeLength(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink){
+   const msocket_length_framing_t *config = &self->length;
+   uint32_t offset = 0u;
+   int8_t retval = 0;
+   self->frameRemain = 0u;
+   while ( (offset < len) && (self->budget > 0u) && (retval == 0) ){
+      uint32_t headerLen = 0u;
+      uint32_t value = 0u;
+      uint64_t frameLen;
+      int8_t result = msocket_framer_lengthHeader(config, data + offset, len - offset, &headerLen, &value);
+      if (result < 0){
+         *parseLen = offset;
+         return -1;
+      }
+      if (result == 0){
+         break; //header incomplete
+      }
+      if (config->includesHeader != 0u){
+         if (value < headerLen){
+            *parseLen = offset;
+            errno = EPROTO;
+            return -1;
+         }
+         frameLen = value;
+      }
+      else{
+         frameLen = (uint64_t) headerLen + value;
+      }
+      if (frameLen > config->maxFrameSize){
+         *parseLen = offset;
+         errno = EMSGSIZE;
+         return -1;
+      }
+      if (frameLen > (uint64_t) (len - offset)){
+         self->frameRemain = (uint32_t) frameLen - (len - offset);
+         break;
+      }
+      retval = msocket_framer_put(sink, data + offset + headerLen, (uint32_t) frameLen - headerLen);
+      if (retval < 0){
+         *parseLen = offset;
+         return -1;
+      }
+      offset += (uint32_t) frameLen;
+      self->budget--;
+   }
+   *parseLen = offset;
+   return retval;
+}
+
+/**
+ * Returns 1 when the header is complete, 0 when more data is needed and -1 when the header is invalid.
+ */
+static int8_t msocket_framer_lengthHeader(const msocket_length_framing_t *config, const uint8_t *data, uint32_t len, uint32_t *headerLen, uint32_t *value){
+   uint32_t i;
+   if (config->headerSize == MSOCKET_LENGTH_VARINT){
+      uint32_t result = 0u;
+      for (i = 0u; i < len; i++){
+         if ( (i == (VARINT_MAX_BYTES - 1u)) && (data[i] > 0x0Fu) ){
+            errno = EPROTO; //value does not fit in 32 bits
+            return -1;
+         }
+         result |= (uint32_t) (data[i] & 0x7Fu) << (7u * i);
+         if ( (data[i] & 0x80u) == 0u){
+            *headerLen = i + 1u;
+            *value = result;
+            return 1;
+         }
+      }
+      return 0;
+   }
+   if (len < config->headerSize){
+      return 0;
+   }
+   *headerLen = config->headerSize;
+   *value = 0u;
+   for (i = 0u; i < config->headerSize; i++){
+      if (config->bigEndian != 0u){
+         *value = (*value << 8) | data[i];
+      }
+      else{
+         *value |= (uint32_t) data[i] << (8u * i);
+      }
+   }
+   return 1;
+}
+
+/**
+ * data starts with the bytes that were left unparsed by the previous call, the first scanPos of them are known
+ * not to contain the delimiter and are not searched again.
+ */
+static int8_t msocket_framer_decodeDelimiter(msocket_framer_t *self, const uint8_t *data, uint32_t len, uint32_t *parseLen, msocket_framer_sink_t *sink){
+   const msocket_delimiter_framing_t *config = &self->delimiter;
+   uint32_t offset = 0u;
+   uint32_t scanPos = (self->scanPos <= len)? self->scanPos : 0u;
+   int8_t retval = 0;
+   self->scanPos = 0u;
+   while ( (offset < len) && (self->budget > 0u) && (retval == 0) ){
+      uint32_t recordLen;
+      const uint8_t *found = msocket_framer_find(data + offset + scanPos, data + len, config->delimiter);
+      if (found == 0){
+         self->scanPos = len - offset;
+         if (self->scanPos >= config->maxFrameSize){
+            *parseLen = offset;
+            errno = EMSGSIZE;
+            return -1;
+         }
+         break;
+      }
+      recordLen = (uint32_t) (found - (data + offset));
+      if (recordLen >= config->maxFrameSize){
+         *parseLen = offset;
+         errno = EMSGSIZE;
+         return -1;
+      }
+      retval = msocket_framer_put(sink, data + offset, recordLen);
+      if (retval < 0){
+         *parseLen = offset;
+         return -1;
+      }
+      offset += recordLen + 1u;
+      scanPos = 0u;
+      self->budget--;
+   }
+   *parseLen = offset;
+   return retval;
+}
+
+/**
+ * Passes the message to the message callback or adds it to the current batch, a full batch is delivered right away.
+ * Returns -1 or 1 when the callback returned a negative or positive value.
+ */
+static int8_t msocket_framer_put(msocket_framer_sink_t *sink, const uint8_t *data, uint32_t len){
+   if (sink->batch == 0){
+      int8_t result = sink->message(sink->arg, data, len);
+      return (result < 0)? -1 : (result > 0)? 1 : 0;
+   }
+   sink->frames[sink->numFrames].data = data;
+   sink->frames[sink->numFrames].len = len;
+   if (++sink->numFrames == MSOCKET_FRAME_BATCH_MAX){
+      return msocket_framer_flush(sink);
+   }
+   return 0;
+}
+
+static int8_t msocket_framer_flush(msocket_framer_sink_t *sink){
+   if (sink->numFrames > 0u){
+      uint32_t numFrames = sink->numFrames;
+      int8_t result;
+      sink->numFrames = 0u;
+      result = sink->batch(sink->arg, &sink->frames[0], numFrames);
+      return (result < 0)? -1 : (result > 0)? 1 : 0;
+   }
+   return 0;
+}
+
+/**
+ * Returns pointer to the first byte equal to value in [begin, end) or NULL when there is none.
+ */
+static const uint8_t *msocket_framer_find(const uint8_t *begin, const uint8_t *end, uint8_t value){
+   if (m_find == 0){
+      msocket_framer_find_t *find = msocket_framer_findScalar;
+#ifdef FRAMER_SSE2
+      find = msocket_framer_findSse2;
+#endif
+#ifdef FRAMER_AVX2
+      if (__builtin_cpu_supports("avx2")){
+         find = msocket_framer_findAvx2;
+      }
+#endif
+      m_find = find; //every thread selects the same function, no lock needed
+   }
+   return m_find(begin, end, value);
+}
+
+static const uint8_t *msocket_framer_findScalar(const uint8_t *begin, const uint8_t *end, uint8_t value){
+   for (; begin < end; begin++){
+      if (*begin == value){
+         return begin;
+      }
+   }
+   return 0;
+}
+
+#ifdef FRAMER_SSE2
+/**
+ * Compares 16 bytes at a time
+ */
+static const uint8_t *msocket_framer_findSse2(const uint8_t *begin, const uint8_t *end, uint8_t value){
+   const __m128i needle = _mm_set1_epi8((char) value);
+   while ( (end - begin) >= 16){
+      __m128i block = _mm_loadu_si128((const __m128i*) begin);
+      uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+      if (mask != 0u){
+         return begin + msocket_framer_firstBit(mask);
+      }
+      begin += 16;
+   }
+   return msocket_framer_findScalar(begin, end, value);
+}
+
+static uint32_t msocket_framer_firstBit(uint32_t mask){
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward(&index, mask);
+   return (uint32_t) index;
+#else
+   return (uint32_t) __builtin_ctz(mask);
+#endif
+}
+#endif
+
+#ifdef FRAMER_AVX2
+/**
+ * Compares 32 bytes at a time, the remainder is left to the SSE2 version
+ */
+__attribute__((target("avx2")))
+static const uint8_t *msocket_framer_findAvx2(const uint8_t *begin, const uint8_t *end, uint8_t value){
+   const __m256i needle = _mm256_set1_epi8((char) value);
+   while ( (end - begin) >= 32){
+      __m256i block = _mm256_loadu_si256((const __m256i*) begin);
+      uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+      if (mask != 0u){
+         return begin + msocket_framer_firstBit(mask);
+      }
+      begin += 32;
+   }
+   return msocket_framer_findSse2(begin, end, value);
+}
+#endif
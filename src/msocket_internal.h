@@ -0,0 +1,78 @@
+/*****************************************************************************
+* \file:    msocket_internal.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Functions shared between msocket and its I/O drivers (not part of public API)
+*
+* Copyright (c) 2014-2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_INTERNAL_H
+#define MSOCKET_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include "msocket.h"
+
+/**************************** Constants and Types ****************************/
+#define MSOCKET_IO_BUF_SIZE 8192
+#define MSOCKET_IO_TIMEOUT_MS 50 //polling interval, only used on Windows where select cannot be woken up by msocket_close
+#define MSOCKET_WORK_RESUME UINT32_MAX //len of the work item that delivers what was left in tcpRxBuf once reading resumes
+
+/********************************* Functions *********************************/
+
+/*
+ * The functions below contain the actual socket event processing. They are called by whatever
+ * I/O driver currently owns the socket, either the ioTask thread in msocket.c or a msocket_reactor_t.
+ * The ones returning int return a negative value when the driver should stop serving the socket.
+ */
+int msocket_ioConnected(msocket_t *self);
+int msocket_ioReadable(msocket_t *self, uint8_t *recvBuf, uint32_t bufSize);
+int msocket_ioReceived(msocket_t *self, uint8_t *recvBuf, int len);
+uint32_t msocket_ioRecvSize(msocket_t *self);
+void msocket_ioRecvFull(msocket_t *self);
+int msocket_ioBacklog(msocket_t *self);
+uint8_t msocket_ioBacklogPending(msocket_t *self);
+uint8_t msocket_ioReadPaused(msocket_t *self);
+int msocket_ioAccepted(msocket_t *self, SOCKET_T sockfd, const struct sockaddr *addr);
+void msocket_ioTimersStart(msocket_t *self, msocket_timerwheel_t *wheel);
+void msocket_ioTimersStop(msocket_t *self);
+int msocket_ioTimer(msocket_t *self, msocket_timer_t *timer, msocket_timer_cb_t *callback);
+void msocket_ioStopped(msocket_t *self);
+uint32_t msocket_timestamp(void);
+
+#ifdef __linux__
+int8_t msocket_reactor_attach(struct msocket_reactor_tag *self, msocket_t *msocket);
+int8_t msocket_reactor_detach(struct msocket_reactor_tag *self, msocket_t *msocket);
+void msocket_reactor_lock(struct msocket_reactor_tag *self);
+void msocket_reactor_unlock(struct msocket_reactor_tag *self);
+void msocket_reactor_notify(struct msocket_reactor_tag *self);
+void msocket_reactor_want_write(struct msocket_reactor_tag *self, msocket_t *msocket);
+void msocket_reactor_want_read(struct msocket_reactor_tag *self, msocket_t *msocket);
+void msocket_reactor_want_errors(struct msocket_reactor_tag *self, msocket_t *msocket);
+void msocket_ioForgetReactor(msocket_t *self);
+int msocket_ioErrQueue(msocket_t *self);
+uint8_t msocket_ioZerocopyPending(msocket_t *self);
+struct msocket_txitem_tag *msocket_ioSendBegin(msocket_t *self, struct iovec *iov, int maxIov, int *iovcnt);
+int msocket_ioSendComplete(msocket_t *self, struct msocket_txitem_tag *items, int result);
+void msocket_ioSendRelease(struct msocket_txitem_tag *items);
+#endif
+
+#ifndef _WIN32
+int msocket_ioWritable(msocket_t *self);
+uint8_t msocket_ioSendPending(msocket_t *self);
+uint32_t msocket_ioWork(msocket_t *self, const uint8_t *data, uint32_t len);
+int8_t msocket_workpool_post(struct msocket_workpool_tag *self, msocket_t *msocket, const uint8_t *data, uint32_t len);
+void msocket_workpool_cancel(struct msocket_workpool_tag *self, msocket_t *msocket);
+uint8_t msocket_workpool_is_worker(struct msocket_workpool_tag *self, msocket_t *msocket);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_INTERNAL_H
@@ -0,0 +1,1407 @@
+/*****************************************************************************
+* \file:    msocket_reactor.c
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Shared epoll event loop serving many msocket objects from one thread (Linux only)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <malloc.h>
+#include <assert.h>
+#ifndef MSOCKET_DEBUG
+#define MSOCKET_DEBUG 0
+#endif
+#ifndef MSOCKET_IO_URING
+#define MSOCKET_IO_URING 0
+#endif
+#include "msocket_reactor.h"
+#include "msocket_internal.h"
+#if MSOCKET_IO_URING
+#include <poll.h>
+#include "msocket_uring.h"
+#endif
+
+#if MSOCKET_DEBUG
+#include <stdio.h>
+#endif
+
+/****************** Constants and Types ***************************/
+
+#if MSOCKET_IO_URING
+#define URING_SEND_IOV_MAX 16 //send queue items gathered into one IORING_OP_SENDMSG
+#endif
+
+typedef struct msocket_reactor_handle_tag{
+   msocket_t *msocket; //set to NULL when socket has been detached
+   struct msocket_reactor_handle_tag *prev;
+   struct msocket_reactor_handle_tag *next;
+   uint8_t connecting; //registered for EPOLLOUT while msocket_connect_async is in progress
+   uint8_t registered; //waiting for events, see msocket_reactor_register
+   uint8_t wantWrite; //registered for EPOLLOUT because the send queue is not empty
+   uint8_t readPaused; //registered without EPOLLIN because reading is paused (not registered at all without wantWrite)
+   uint8_t backlogQueued; //in list of sockets with messages left over by the read budget
+   struct msocket_reactor_handle_tag *backlogNext;
+#if MSOCKET_IO_URING
+   uint8_t opsInFlight; //bit mask of URING_OP_XXX
+   uint8_t cancelled;
+   uint8_t writeQueued; //in list of sockets waiting for a write poll to be submitted
+   uint8_t errPoll; //URING_OP_POLL in flight waits for zero-copy completions on the error queue
+   struct msocket_reactor_handle_tag *writeNext;
+   struct msocket_txitem_tag *txItems; //send queue items of the URING_OP_WRITE send in flight, see msocket_ioSendBegin
+   struct msghdr txMsg;
+   struct iovec txIov[URING_SEND_IOV_MAX];
+   uint8_t *recvBuf;
+   uint32_t recvBufSize; //follows the adaptive receive size of the socket
+   struct sockaddr_storage peerAddr;
+   socklen_t peerAddrLen;
+#endif
+}msocket_reactor_handle_t;
+
+#if MSOCKET_IO_URING
+//operation type is stored in the lower bits of user_data, the remaining bits hold the handle pointer
+#define URING_OP_MASK       7u
+#define URING_OP_RECV       1u
+#define URING_OP_ACCEPT     2u
+#define URING_OP_POLL       3u
+#define URING_OP_CANCEL     4u
+#define URING_OP_WAKEUP     5u
+#define URING_OP_TIMEOUT    6u
+#define URING_OP_WRITE      7u
+
+typedef struct msocket_reactor_uring_tag{
+   msocket_uring_t ring;
+   struct __kernel_timespec timeout;
+   msocket_reactor_handle_t *zombies; //detached handles waiting for their operations to be cancelled
+   msocket_reactor_handle_t *writers; //handles whose send queue became non-empty, see msocket_reactor_want_write
+   uint32_t inFlight;
+   uint32_t timeoutDue; //expiry time of most recently submitted timeout operation
+   uint32_t timeoutsInFlight;
+}msocket_reactor_uring_t;
+
+# define REACTOR_DEFAULT_BACKEND MSOCKET_REACTOR_BACKEND_IO_URING
+#else
+# define REACTOR_DEFAULT_BACKEND MSOCKET_REACTOR_BACKEND_EPOLL
+#endif
+
+/**************** Private Function Declarations *******************/
+static THREAD_PROTO(reactorTask,arg);
+static void msocket_reactor_runEpoll(msocket_reactor_t *self);
+static int msocket_reactor_register(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_freeHandle(msocket_reactor_handle_t *handle);
+static void msocket_reactor_wakeup(msocket_reactor_t *self);
+static void msocket_reactor_startPending(msocket_reactor_t *self);
+static void msocket_reactor_dispatch(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint32_t events);
+static int msocket_reactor_connected(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static int msocket_reactor_modify(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint8_t wantWrite);
+static int msocket_reactor_updateRead(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_runTimers(msocket_reactor_t *self);
+static int msocket_reactor_nextTimeout(msocket_reactor_t *self);
+static void msocket_reactor_unlink(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_forget(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_backlogPush(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_backlogRemove(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_serveBacklog(msocket_reactor_t *self);
+static uint8_t msocket_reactor_hasBacklog(msocket_reactor_t *self);
+static void msocket_reactor_freeGarbage(msocket_reactor_t *self);
+static uint8_t msocket_reactor_isReactorThread(msocket_reactor_t *self);
+#if MSOCKET_IO_URING
+static void msocket_reactor_runUring(msocket_reactor_t *self);
+static struct io_uring_sqe *msocket_reactor_uringSqe(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint32_t op);
+static int msocket_reactor_uringArm(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static int msocket_reactor_uringArmWrite(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static int msocket_reactor_uringArmErrors(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_uringArmWriters(msocket_reactor_t *self);
+static void msocket_reactor_uringArmWakeup(msocket_reactor_t *self);
+static void msocket_reactor_uringArmTimeout(msocket_reactor_t *self);
+static void msocket_reactor_uringComplete(msocket_reactor_t *self, uint64_t userData, int result);
+static void msocket_reactor_uringCancel(msocket_reactor_t *self, msocket_reactor_handle_t *handle);
+static void msocket_reactor_uringShutdown(msocket_reactor_t *self);
+#endif
+
+/****************** Public Function Definitions *******************/
+int8_t msocket_reactor_create(msocket_reactor_t *self){
+   if (self != 0){
+      struct epoll_event event;
+      self->handles = (msocket_reactor_handle_t*) 0;
+      self->pending = (msocket_reactor_handle_t*) 0;
+      self->garbage = (msocket_reactor_handle_t*) 0;
+      self->backlog = (msocket_reactor_handle_t*) 0;
+      self->backlogTail = (msocket_reactor_handle_t*) 0;
+      self->current = (msocket_t*) 0;
+      self->numSockets = 0u;
+      self->numBacklog = 0u;
+      self->threadRunning = 0u;
+      self->stopRequest = 0u;
+      msocket_timerwheel_create(&self->timers, msocket_timestamp());
+      self->uring = (struct msocket_reactor_uring_tag*) 0;
+      self->backend = REACTOR_DEFAULT_BACKEND;
+      self->recvBuf = (uint8_t*) malloc(MSOCKET_IO_BUF_SIZE);
+      if (self->recvBuf == 0){
+         errno = ENOMEM;
+         return -1;
+      }
+      self->epollfd = epoll_create1(EPOLL_CLOEXEC);
+      if (self->epollfd < 0){
+         free(self->recvBuf);
+         return -1;
+      }
+      self->wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (self->wakeupfd < 0){
+         close(self->epollfd);
+         free(self->recvBuf);
+         return -1;
+      }
+      memset(&event, 0, sizeof(event));
+      event.events = EPOLLIN;
+      event.data.ptr = (void*) 0; //wakeupfd is the only registered fd without a handle
+      if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, self->wakeupfd, &event) < 0){
+         close(self->wakeupfd);
+         close(self->epollfd);
+         free(self->recvBuf);
+         return -1;
+      }
+      MUTEX_INIT(self->mutex);
+      pthread_cond_init(&self->cond, 0);
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Stops the reactor thread. Sockets still attached to the reactor are left open but will no longer be served.
+ * They also forget the reactor, later calls on them (timers, msocket_pause_read etc.) no longer refer to it.
+ */
+void msocket_reactor_destroy(msocket_reactor_t *self){
+   if (self != 0){
+      msocket_reactor_stop(self);
+      MUTEX_LOCK(self->mutex);
+      while (self->pending != 0){
+         msocket_reactor_forget(self, self->pending);
+      }
+      while (self->handles != 0){
+         msocket_reactor_forget(self, self->handles);
+      }
+      MUTEX_UNLOCK(self->mutex);
+      msocket_reactor_freeGarbage(self);
+      close(self->wakeupfd);
+      close(self->epollfd);
+      free(self->recvBuf);
+      pthread_cond_destroy(&self->cond);
+      MUTEX_DESTROY(self->mutex);
+   }
+}
+
+msocket_reactor_t *msocket_reactor_new(void){
+   msocket_reactor_t *self = (msocket_reactor_t*) malloc(sizeof(msocket_reactor_t));
+   if (self != 0){
+      int8_t rc = msocket_reactor_create(self);
+      if (rc != 0){
+         free(self);
+         self = (msocket_reactor_t*) 0;
+      }
+   }
+   return self;
+}
+
+void msocket_reactor_delete(msocket_reactor_t *self){
+   if (self != 0){
+      msocket_reactor_destroy(self);
+      free(self);
+   }
+}
+
+/**
+ * When the io_uring backend is selected but not available in the running kernel the reactor falls back to epoll.
+ */
+int8_t msocket_reactor_start(msocket_reactor_t *self){
+   if ( (self != 0) && (self->threadRunning == 0) ){
+      int rc;
+      self->stopRequest = 0u;
+#if MSOCKET_IO_URING
+      if (self->backend == MSOCKET_REACTOR_BACKEND_IO_URING){
+         self->uring = (msocket_reactor_uring_t*) malloc(sizeof(msocket_reactor_uring_t));
+         if ( (self->uring != 0) && (msocket_uring_init(&self->uring->ring, MSOCKET_URING_DEFAULT_ENTRIES) != 0) ){
+            free(self->uring);
+            self->uring = (msocket_reactor_uring_t*) 0;
+         }
+         if (self->uring == 0){
+#if MSOCKET_DEBUG
+            printf("[MSOCKET] io_uring not available, falling back to epoll\n");
+#endif
+            self->backend = MSOCKET_REACTOR_BACKEND_EPOLL;
+         }
+         else{
+            self->uring->zombies = (msocket_reactor_handle_t*) 0;
+            self->uring->writers = (msocket_reactor_handle_t*) 0;
+            self->uring->inFlight = 0u;
+            self->uring->timeoutsInFlight = 0u;
+         }
+      }
+#endif
+      rc = THREAD_CREATE(self->thread, reactorTask, self);
+      if (rc != 0){
+#if MSOCKET_IO_URING
+         if (self->uring != 0){
+            msocket_uring_exit(&self->uring->ring);
+            free(self->uring);
+            self->uring = (msocket_reactor_uring_t*) 0;
+         }
+#endif
+         return -1;
+      }
+      self->threadRunning = 1u;
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+void msocket_reactor_stop(msocket_reactor_t *self){
+   if ( (self != 0) && (self->threadRunning != 0) ){
+      if (msocket_reactor_isReactorThread(self) != 0){
+#if MSOCKET_DEBUG
+         printf("[MSOCKET] Not allowed to call msocket_reactor_stop from reactor thread\n");
+#endif
+         return;
+      }
+      MUTEX_LOCK(self->mutex);
+      self->stopRequest = 1u;
+      MUTEX_UNLOCK(self->mutex);
+      msocket_reactor_wakeup(self);
+      THREAD_JOIN(self->thread);
+      self->threadRunning = 0u;
+#if MSOCKET_IO_URING
+      if (self->uring != 0){
+         msocket_uring_exit(&self->uring->ring);
+         free(self->uring);
+         self->uring = (msocket_reactor_uring_t*) 0;
+      }
+#endif
+   }
+}
+
+uint32_t msocket_reactor_num_sockets(msocket_reactor_t *self){
+   uint32_t retval = 0u;
+   if (self != 0){
+      MUTEX_LOCK(self->mutex);
+      retval = self->numSockets;
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return retval;
+}
+
+/**
+ * Selects I/O backend, must be called before msocket_reactor_start.
+ * Returns -1 (errno=ENOTSUP) when the library was built without support for the requested backend.
+ */
+int8_t msocket_reactor_set_backend(msocket_reactor_t *self, uint8_t backend){
+   if ( (self != 0) && (self->threadRunning == 0) ){
+      if (backend == MSOCKET_REACTOR_BACKEND_EPOLL){
+         self->backend = backend;
+         return 0;
+      }
+#if MSOCKET_IO_URING
+      if (backend == MSOCKET_REACTOR_BACKEND_IO_URING){
+         self->backend = backend;
+         return 0;
+      }
+#endif
+      errno = ENOTSUP;
+      return -1;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Returns the backend in use (after msocket_reactor_start this reflects a possible fallback to epoll).
+ */
+uint8_t msocket_reactor_backend(msocket_reactor_t *self){
+   if (self != 0){
+      return self->backend;
+   }
+   return MSOCKET_REACTOR_BACKEND_EPOLL;
+}
+
+/**
+ * Called from msocket_start_io (through msocket_startIoThread). The tcp_connected callback (if any) is triggered from the reactor thread.
+ */
+int8_t msocket_reactor_attach(msocket_reactor_t *self, msocket_t *msocket){
+   if ( (self != 0) && (msocket != 0) ){
+      msocket_reactor_handle_t *handle = (msocket_reactor_handle_t*) malloc(sizeof(msocket_reactor_handle_t));
+      if (handle == 0){
+         errno = ENOMEM;
+         return -1;
+      }
+      handle->msocket = msocket;
+      handle->prev = (msocket_reactor_handle_t*) 0;
+      handle->connecting = 0u;
+      handle->registered = 0u;
+      handle->wantWrite = 0u;
+      handle->readPaused = 0u;
+      handle->backlogQueued = 0u;
+      handle->backlogNext = (msocket_reactor_handle_t*) 0;
+#if MSOCKET_IO_URING
+      handle->opsInFlight = 0u;
+      handle->cancelled = 0u;
+      handle->writeQueued = 0u;
+      handle->errPoll = 0u;
+      handle->writeNext = (msocket_reactor_handle_t*) 0;
+      handle->txItems = (struct msocket_txitem_tag*) 0;
+      handle->recvBuf = (uint8_t*) 0;
+      handle->recvBufSize = 0u;
+#endif
+      MUTEX_LOCK(self->mutex);
+      handle->next = self->pending;
+      if (self->pending != 0){
+         self->pending->prev = handle;
+      }
+      self->pending = handle;
+      msocket->reactorHandle = handle;
+      self->numSockets++;
+      MUTEX_UNLOCK(self->mutex);
+      msocket_reactor_wakeup(self);
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Removes socket from reactor. When this function returns the reactor thread will never touch the socket again.
+ * Returns -1 if called from within a callback of the socket itself (the socket is then detached after the callback returns).
+ */
+int8_t msocket_reactor_detach(msocket_reactor_t *self, msocket_t *msocket){
+   if ( (self != 0) && (msocket != 0) ){
+      int8_t retval = 0;
+      MUTEX_LOCK(self->mutex);
+      if (msocket_reactor_isReactorThread(self) != 0){
+         if (self->current == msocket){
+            retval = -1;
+         }
+      }
+      else{
+         while (self->current == msocket){
+            pthread_cond_wait(&self->cond, &self->mutex);
+         }
+      }
+      if ( (retval == 0) && (msocket->reactorHandle != 0) ){
+         msocket_reactor_unlink(self, (msocket_reactor_handle_t*) msocket->reactorHandle);
+      }
+      MUTEX_UNLOCK(self->mutex);
+      return retval;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+void msocket_reactor_lock(msocket_reactor_t *self){
+   MUTEX_LOCK(self->mutex);
+}
+
+void msocket_reactor_unlock(msocket_reactor_t *self){
+   MUTEX_UNLOCK(self->mutex);
+}
+
+/**
+ * Called by msocket_send when the send queue of msocket was empty, the reactor flushes the queue once the socket is writable.
+ */
+void msocket_reactor_want_write(msocket_reactor_t *self, msocket_t *msocket){
+   msocket_reactor_handle_t *handle;
+   uint8_t wakeup = 0u;
+   MUTEX_LOCK(self->mutex);
+   handle = (msocket_reactor_handle_t*) msocket->reactorHandle;
+   //handles that are not yet registered check the send queue in msocket_reactor_register
+   if ( (handle != 0) && (handle->registered != 0u) ){
+#if MSOCKET_IO_URING
+      if (self->uring != 0){
+         if (handle->writeQueued == 0u){
+            handle->writeQueued = 1u;
+            handle->writeNext = self->uring->writers;
+            self->uring->writers = handle;
+            wakeup = 1u;
+         }
+      }
+      else
+#endif
+      if ( (handle->connecting == 0u) && (handle->wantWrite == 0u) ){
+         (void) msocket_reactor_modify(self, handle, 1u);
+      }
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if ( (wakeup != 0u) && (msocket_reactor_isReactorThread(self) == 0) ){
+      msocket_reactor_wakeup(self);
+   }
+}
+
+/**
+ * Called by msocket_resume_read and by the workpool when a socket may receive again. Messages left in its receive
+ * buffer are delivered from the backlog, which also starts receiving again.
+ */
+void msocket_reactor_want_read(msocket_reactor_t *self, msocket_t *msocket){
+   msocket_reactor_handle_t *handle;
+   uint8_t wakeup = 0u;
+   MUTEX_LOCK(self->mutex);
+   handle = (msocket_reactor_handle_t*) msocket->reactorHandle;
+   if ( (handle != 0) && (handle->registered != 0u) ){
+      msocket_reactor_backlogPush(self, handle);
+      wakeup = 1u;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if ( (wakeup != 0u) && (msocket_reactor_isReactorThread(self) == 0) ){
+      msocket_reactor_wakeup(self);
+   }
+}
+
+/**
+ * Called by msocket_send_zerocopy when the kernel holds on to a buffer, the reactor then watches the error queue for
+ * completions. Only the io_uring backend needs to be told, epoll always reports EPOLLERR.
+ */
+void msocket_reactor_want_errors(msocket_reactor_t *self, msocket_t *msocket){
+#if MSOCKET_IO_URING
+   msocket_reactor_handle_t *handle;
+   uint8_t wakeup = 0u;
+   MUTEX_LOCK(self->mutex);
+   handle = (msocket_reactor_handle_t*) msocket->reactorHandle;
+   if ( (self->uring != 0) && (handle != 0) && (handle->registered != 0u) && (handle->writeQueued == 0u) ){
+      handle->writeQueued = 1u;
+      handle->writeNext = self->uring->writers;
+      self->uring->writers = handle;
+      wakeup = 1u;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   if ( (wakeup != 0u) && (msocket_reactor_isReactorThread(self) == 0) ){
+      msocket_reactor_wakeup(self);
+   }
+#else
+   (void) self;
+   (void) msocket;
+#endif
+}
+
+/**
+ * Wakes up the reactor thread (unless called from it) so that it picks up a changed timer deadline.
+ */
+void msocket_reactor_notify(msocket_reactor_t *self){
+   if (msocket_reactor_isReactorThread(self) == 0){
+      msocket_reactor_wakeup(self);
+   }
+}
+
+/***************** Private Function Definitions *******************/
+
+static THREAD_PROTO(reactorTask,arg){
+   msocket_reactor_t *self = (msocket_reactor_t*) arg;
+   if (self != 0){
+# if(MSOCKET_DEBUG)
+      printf("[MSOCKET](0x%p) reactorTask starting\n",arg);
+#endif
+#if MSOCKET_IO_URING
+      if (self->uring != 0){
+         msocket_reactor_runUring(self);
+      }
+      else
+#endif
+      {
+         msocket_reactor_runEpoll(self);
+      }
+   }
+# if(MSOCKET_DEBUG)
+   printf("[MSOCKET](0x%p) reactorTask exiting\n",arg);
+#endif
+   THREAD_RETURN(0);
+}
+
+static void msocket_reactor_runEpoll(msocket_reactor_t *self){
+   struct epoll_event events[MSOCKET_REACTOR_MAX_EVENTS];
+   while(1){
+      int i;
+      int numEvents;
+      uint8_t stopRequest;
+      MUTEX_LOCK(self->mutex);
+      stopRequest = self->stopRequest;
+      MUTEX_UNLOCK(self->mutex);
+      if (stopRequest != 0){
+         break;
+      }
+      msocket_reactor_startPending(self);
+      msocket_reactor_serveBacklog(self);
+      //with a backlog, only check for new events before each socket gets its next read budget
+      numEvents = epoll_wait(self->epollfd, &events[0], MSOCKET_REACTOR_MAX_EVENTS, (msocket_reactor_hasBacklog(self) != 0u)? 0 : msocket_reactor_nextTimeout(self));
+      if (numEvents < 0){
+         if (errno == EINTR){
+            continue;
+         }
+#if(MSOCKET_DEBUG)
+         perror("msocket: epoll_wait failed: ");
+#endif
+         break;
+      }
+      for (i = 0; i < numEvents; i++){
+         msocket_reactor_handle_t *handle = (msocket_reactor_handle_t*) events[i].data.ptr;
+         if (handle == 0){
+            uint64_t value;
+            ssize_t result = read(self->wakeupfd, &value, sizeof(value));
+            (void) result;
+         }
+         else{
+            msocket_reactor_dispatch(self, handle, events[i].events);
+         }
+      }
+      msocket_reactor_runTimers(self);
+      msocket_reactor_freeGarbage(self);
+   }
+}
+
+/**
+ * Starts waiting for events on a newly started socket. Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_register(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   struct epoll_event event;
+   msocket_t *msocket = handle->msocket;
+   SOCKET_T sockfd = (msocket->socketMode & MSOCKET_MODE_UDP)? msocket->udpsockfd : msocket->tcpsockfd;
+   handle->registered = 1u;
+#if MSOCKET_IO_URING
+   if (self->uring != 0){
+      if (msocket_reactor_uringArm(self, handle) < 0){
+         return -1;
+      }
+      if ( (msocket_ioSendPending(msocket) != 0u) && (msocket_reactor_uringArmWrite(self, handle) < 0) ){
+         return -1;
+      }
+      //msocket_reactor_want_errors has no effect before the socket is registered
+      return (msocket_ioZerocopyPending(msocket) != 0u)? msocket_reactor_uringArmErrors(self, handle) : 0;
+   }
+#endif
+   memset(&event, 0, sizeof(event));
+   handle->connecting = (msocket_state(msocket) == MSOCKET_STATE_PENDING)? 1u : 0u;
+   if (handle->connecting != 0u){
+      event.events = EPOLLOUT;
+   }
+   else{
+      handle->wantWrite = ( ( (msocket->socketMode & MSOCKET_MODE_TCP) != 0) && (msocket_ioSendPending(msocket) != 0u) )? 1u : 0u;
+      event.events = (handle->wantWrite != 0u)? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+   }
+   event.data.ptr = (void*) handle;
+   if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, sockfd, &event) < 0){
+#if(MSOCKET_DEBUG)
+      perror("msocket: epoll_ctl failed: ");
+#endif
+      return -1;
+   }
+   return 0;
+}
+
+static void msocket_reactor_freeHandle(msocket_reactor_handle_t *handle){
+#if MSOCKET_IO_URING
+   if (handle->recvBuf != 0){
+      free(handle->recvBuf);
+   }
+   msocket_ioSendRelease(handle->txItems);
+#endif
+   free(handle);
+}
+
+static void msocket_reactor_wakeup(msocket_reactor_t *self){
+   uint64_t value = 1u;
+   ssize_t result = write(self->wakeupfd, &value, sizeof(value));
+   (void) result;
+}
+
+/**
+ * Moves newly attached sockets into the active set after their tcp_connected callback has been triggered
+ */
+static void msocket_reactor_startPending(msocket_reactor_t *self){
+   while(1){
+      msocket_reactor_handle_t *handle;
+      msocket_t *msocket;
+      int result;
+      MUTEX_LOCK(self->mutex);
+      handle = self->pending;
+      if (handle == 0){
+         MUTEX_UNLOCK(self->mutex);
+         break;
+      }
+      msocket = handle->msocket;
+      self->pending = handle->next;
+      if (self->pending != 0){
+         self->pending->prev = (msocket_reactor_handle_t*) 0;
+      }
+      handle->prev = (msocket_reactor_handle_t*) 0;
+      handle->next = self->handles;
+      if (self->handles != 0){
+         self->handles->prev = handle;
+      }
+      self->handles = handle;
+      self->current = msocket;
+      msocket_ioTimersStart(msocket, &self->timers);
+      MUTEX_UNLOCK(self->mutex);
+      result = msocket_ioConnected(msocket);
+      MUTEX_LOCK(self->mutex);
+      self->current = (msocket_t*) 0;
+      if ( (result < 0) || (msocket_reactor_register(self, handle) < 0) ){
+         msocket_reactor_unlink(self, handle);
+      }
+      pthread_cond_broadcast(&self->cond);
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+static void msocket_reactor_dispatch(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint32_t events){
+   msocket_t *msocket;
+   int result = 0;
+   MUTEX_LOCK(self->mutex);
+   msocket = handle->msocket;
+   if (msocket == 0){
+      MUTEX_UNLOCK(self->mutex);
+      return; //detached while this batch of events was being processed
+   }
+   self->current = msocket;
+   MUTEX_UNLOCK(self->mutex);
+   if ( (handle->connecting == 0u) && ( (events & EPOLLERR) != 0u) ){
+      result = msocket_ioErrQueue(msocket);
+      if (result > 0){
+         events &= ~((uint32_t) EPOLLERR); //zero-copy completions, not a socket error
+         result = 0;
+      }
+   }
+   if ( (result >= 0) && (handle->connecting == 0u) && ( (events & EPOLLOUT) != 0u) ){
+      result = msocket_ioWritable(msocket);
+   }
+   if ( (result >= 0) && ( (handle->connecting != 0u) || ( (events & ~((uint32_t) EPOLLOUT)) != 0u) ) ){
+      result = msocket_ioReadable(msocket, self->recvBuf, MSOCKET_IO_BUF_SIZE);
+   }
+   MUTEX_LOCK(self->mutex);
+   self->current = (msocket_t*) 0;
+   if (result >= 0){
+      if (handle->connecting != 0u){
+         result = msocket_reactor_connected(self, handle);
+      }
+      else if ( (handle->wantWrite != 0u) && (msocket_ioSendPending(msocket) == 0u) ){
+         result = msocket_reactor_modify(self, handle, 0u); //send queue drained
+      }
+      if (result >= 0){
+         result = msocket_reactor_updateRead(self, handle);
+      }
+   }
+   if (result < 0){
+      msocket_reactor_unlink(self, handle);
+   }
+   pthread_cond_broadcast(&self->cond);
+   MUTEX_UNLOCK(self->mutex);
+}
+
+/**
+ * Switches socket from waiting for connect completion (EPOLLOUT) to receiving. Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_connected(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   if (msocket_state(handle->msocket) == MSOCKET_STATE_PENDING){
+      return 0;
+   }
+   handle->connecting = 0u;
+   return msocket_reactor_modify(self, handle, msocket_ioSendPending(handle->msocket));
+}
+
+/**
+ * Changes epoll registration of TCP socket to EPOLLIN with or without EPOLLOUT, leaving out EPOLLIN while reading is paused.
+ * Without any events the socket is taken out of epoll, which would otherwise keep reporting EPOLLHUP.
+ * Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_modify(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint8_t wantWrite){
+   struct epoll_event event;
+   SOCKET_T sockfd = handle->msocket->tcpsockfd;
+   int op = ( (handle->readPaused != 0u) && (handle->wantWrite == 0u) )? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+   memset(&event, 0, sizeof(event));
+   handle->readPaused = msocket_ioReadPaused(handle->msocket);
+   event.events = (handle->readPaused != 0u)? 0u : EPOLLIN;
+   if (wantWrite != 0u){
+      event.events |= EPOLLOUT;
+   }
+   event.data.ptr = (void*) handle;
+   handle->wantWrite = wantWrite;
+   if (event.events == 0u){
+      return (op == EPOLL_CTL_MOD)? epoll_ctl(self->epollfd, EPOLL_CTL_DEL, sockfd, (struct epoll_event*) 0) : 0;
+   }
+   return epoll_ctl(self->epollfd, op, sockfd, &event);
+}
+
+/**
+ * Follows the socket's reading after its handlers ran: queues it in the backlog when messages were left over by the
+ * read budget, otherwise stops or starts receiving when reading was paused or resumed. Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_updateRead(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   msocket_t *msocket = handle->msocket;
+   uint8_t readPaused;
+   if ( (msocket->socketMode & MSOCKET_MODE_TCP) == 0){
+      return 0;
+   }
+   readPaused = msocket_ioReadPaused(msocket);
+   if ( (readPaused == 0u) && (msocket_ioBacklogPending(msocket) != 0u) ){
+      msocket_reactor_backlogPush(self, handle); //next receive waits until the backlog has been delivered
+      return 0;
+   }
+#if MSOCKET_IO_URING
+   if (self->uring != 0){
+      if ( (readPaused == 0u) && (handle->cancelled == 0u) && ( (handle->opsInFlight & (1u << URING_OP_RECV)) == 0u) ){
+         return msocket_reactor_uringArm(self, handle);
+      }
+      return 0;
+   }
+#endif
+   if ( (handle->connecting == 0u) && (readPaused != handle->readPaused) ){
+      return msocket_reactor_modify(self, handle, handle->wantWrite);
+   }
+   return 0;
+}
+
+/**
+ * Runs callbacks of expired timers
+ */
+static void msocket_reactor_runTimers(msocket_reactor_t *self){
+   uint32_t now = msocket_timestamp();
+   MUTEX_LOCK(self->mutex);
+   while(1){
+      msocket_timer_t *timer = msocket_timerwheel_expire(&self->timers, now);
+      msocket_timer_cb_t *callback;
+      msocket_t *msocket;
+      int result;
+      if (timer == 0){
+         break;
+      }
+      msocket = (msocket_t*) timer->owner;
+      callback = timer->callback;
+      self->current = msocket;
+      MUTEX_UNLOCK(self->mutex);
+      result = msocket_ioTimer(msocket, timer, callback);
+      MUTEX_LOCK(self->mutex);
+      self->current = (msocket_t*) 0;
+      if ( (result < 0) && (msocket->reactorHandle != 0) ){
+         msocket_reactor_unlink(self, (msocket_reactor_handle_t*) msocket->reactorHandle);
+      }
+      pthread_cond_broadcast(&self->cond);
+   }
+   MUTEX_UNLOCK(self->mutex);
+}
+
+/**
+ * Returns milliseconds until next timer expires, -1 when no timer is running
+ */
+static int msocket_reactor_nextTimeout(msocket_reactor_t *self){
+   uint32_t delayMs;
+   MUTEX_LOCK(self->mutex);
+   delayMs = msocket_timerwheel_next(&self->timers, msocket_timestamp());
+   MUTEX_UNLOCK(self->mutex);
+   return (delayMs > (uint32_t) INT32_MAX)? -1 : (int) delayMs;
+}
+
+/**
+ * Removes handle from its list and moves it to the garbage list. Caller must hold the reactor mutex.
+ */
+static void msocket_reactor_unlink(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   msocket_t *msocket = handle->msocket;
+   if (msocket == 0){
+      return;
+   }
+   if (handle->prev != 0){
+      handle->prev->next = handle->next;
+   }
+   else if (self->handles == handle){
+      self->handles = handle->next;
+   }
+   else{
+      assert(self->pending == handle);
+      self->pending = handle->next;
+   }
+   if (handle->next != 0){
+      handle->next->prev = handle->prev;
+   }
+#if MSOCKET_IO_URING
+   if ( (self->uring != 0) && (handle->writeQueued != 0u) ){
+      msocket_reactor_handle_t **ppHandle = &self->uring->writers;
+      while (*ppHandle != handle){
+         ppHandle = &(*ppHandle)->writeNext;
+      }
+      *ppHandle = handle->writeNext;
+      handle->writeQueued = 0u;
+   }
+#endif
+   msocket_reactor_backlogRemove(self, handle);
+   if (self->uring == 0){
+      if ( (msocket->socketMode & MSOCKET_MODE_UDP) != 0 ){
+         epoll_ctl(self->epollfd, EPOLL_CTL_DEL, msocket->udpsockfd, (struct epoll_event*) 0);
+      }
+      else if ( (msocket->socketMode & MSOCKET_MODE_TCP) != 0 ){
+         epoll_ctl(self->epollfd, EPOLL_CTL_DEL, msocket->tcpsockfd, (struct epoll_event*) 0);
+      }
+   }
+   handle->msocket = (msocket_t*) 0;
+   handle->prev = (msocket_reactor_handle_t*) 0;
+   handle->next = self->garbage;
+   self->garbage = handle;
+   msocket->reactorHandle = (void*) 0;
+   self->numSockets--;
+   msocket_ioTimersStop(msocket);
+   msocket_ioStopped(msocket);
+}
+
+/**
+ * Unlinks a socket that is still attached when the reactor is destroyed and clears its reference to the reactor.
+ * Caller must hold the reactor mutex.
+ */
+static void msocket_reactor_forget(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   msocket_t *msocket = handle->msocket;
+   msocket_reactor_unlink(self, handle);
+   if (msocket != 0){
+      msocket_ioForgetReactor(msocket);
+   }
+}
+
+/**
+ * Appends socket to the sockets with messages left over by the read budget. Caller must hold the reactor mutex.
+ */
+static void msocket_reactor_backlogPush(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   if (handle->backlogQueued == 0u){
+      handle->backlogQueued = 1u;
+      handle->backlogNext = (msocket_reactor_handle_t*) 0;
+      if (self->backlogTail == 0){
+         self->backlog = handle;
+      }
+      else{
+         self->backlogTail->backlogNext = handle;
+      }
+      self->backlogTail = handle;
+      self->numBacklog++;
+   }
+}
+
+/**
+ * Caller must hold the reactor mutex.
+ */
+static void msocket_reactor_backlogRemove(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   if (handle->backlogQueued != 0u){
+      msocket_reactor_handle_t **ppHandle = &self->backlog;
+      msocket_reactor_handle_t *prev = (msocket_reactor_handle_t*) 0;
+      while (*ppHandle != handle){
+         prev = *ppHandle;
+         ppHandle = &prev->backlogNext;
+      }
+      *ppHandle = handle->backlogNext;
+      if (self->backlogTail == handle){
+         self->backlogTail = prev;
+      }
+      handle->backlogQueued = 0u;
+      handle->backlogNext = (msocket_reactor_handle_t*) 0;
+      self->numBacklog--;
+   }
+}
+
+/**
+ * Gives each socket in the backlog one more read budget, in the order they ran out of it. Sockets that are still not
+ * done go to the back of the list, the others start receiving again.
+ */
+static void msocket_reactor_serveBacklog(msocket_reactor_t *self){
+   uint32_t count;
+   MUTEX_LOCK(self->mutex);
+   for (count = self->numBacklog; (count > 0u) && (self->backlog != 0); count--){
+      msocket_reactor_handle_t *handle = self->backlog;
+      msocket_t *msocket = handle->msocket;
+      int result;
+      msocket_reactor_backlogRemove(self, handle);
+      self->current = msocket;
+      MUTEX_UNLOCK(self->mutex);
+      result = msocket_ioBacklog(msocket);
+      MUTEX_LOCK(self->mutex);
+      self->current = (msocket_t*) 0;
+      if (result >= 0){
+         result = msocket_reactor_updateRead(self, handle);
+      }
+      if (result < 0){
+         msocket_reactor_unlink(self, handle);
+      }
+      pthread_cond_broadcast(&self->cond);
+   }
+   MUTEX_UNLOCK(self->mutex);
+}
+
+static uint8_t msocket_reactor_hasBacklog(msocket_reactor_t *self){
+   uint8_t retval;
+   MUTEX_LOCK(self->mutex);
+   retval = (self->backlog != 0)? 1u : 0u;
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+
+static void msocket_reactor_freeGarbage(msocket_reactor_t *self){
+   msocket_reactor_handle_t *handle;
+   MUTEX_LOCK(self->mutex);
+   handle = self->garbage;
+   self->garbage = (msocket_reactor_handle_t*) 0;
+   MUTEX_UNLOCK(self->mutex);
+   while (handle != 0){
+      msocket_reactor_handle_t *next = handle->next;
+#if MSOCKET_IO_URING
+      if ( (self->uring != 0) && (handle->opsInFlight != 0u) ){
+         //kernel may still write into handle->recvBuf, keep the handle until its operations have been cancelled
+         msocket_reactor_uringCancel(self, handle);
+         handle->next = self->uring->zombies;
+         self->uring->zombies = handle;
+      }
+      else
+#endif
+      {
+         msocket_reactor_freeHandle(handle);
+      }
+      handle = next;
+   }
+#if MSOCKET_IO_URING
+   if (self->uring != 0){
+      msocket_reactor_handle_t **ppHandle = &self->uring->zombies;
+      while (*ppHandle != 0){
+         handle = *ppHandle;
+         if (handle->opsInFlight == 0u){
+            *ppHandle = handle->next;
+            msocket_reactor_freeHandle(handle);
+         }
+         else{
+            ppHandle = &handle->next;
+         }
+      }
+   }
+#endif
+}
+
+static uint8_t msocket_reactor_isReactorThread(msocket_reactor_t *self){
+   if ( (self->threadRunning != 0) && (pthread_equal(pthread_self(), self->thread) != 0) ){
+      return 1u;
+   }
+   return 0u;
+}
+
+#if MSOCKET_IO_URING
+
+/**
+ * Event loop for io_uring backend. All receive and accept operations of the served sockets are submitted together with
+ * a single io_uring_enter call, which also waits for the next batch of completions.
+ */
+static void msocket_reactor_runUring(msocket_reactor_t *self){
+   msocket_reactor_uring_t *uring = self->uring;
+   msocket_reactor_handle_t *handle;
+   msocket_reactor_uringArmWakeup(self);
+   MUTEX_LOCK(self->mutex);
+   for (handle = self->handles; handle != 0; handle = handle->next){
+      //sockets left over from a previous msocket_reactor_stop
+      handle->cancelled = 0u;
+      (void) msocket_reactor_register(self, handle);
+   }
+   MUTEX_UNLOCK(self->mutex);
+   while(1){
+      struct io_uring_cqe *cqe;
+      uint8_t stopRequest;
+      MUTEX_LOCK(self->mutex);
+      stopRequest = self->stopRequest;
+      MUTEX_UNLOCK(self->mutex);
+      if (stopRequest != 0){
+         break;
+      }
+      msocket_reactor_startPending(self);
+      msocket_reactor_serveBacklog(self);
+      msocket_reactor_uringArmWriters(self);
+      msocket_reactor_uringArmTimeout(self);
+      //with a backlog, only collect completions that are already there before each socket gets its next read budget
+      if (msocket_uring_submit(&uring->ring, (msocket_reactor_hasBacklog(self) != 0u)? 0u : 1u) < 0){
+         if ( (errno != EINTR) && (errno != EBUSY) && (errno != EAGAIN) ){
+#if(MSOCKET_DEBUG)
+            perror("msocket: io_uring_enter failed: ");
+#endif
+            break;
+         }
+      }
+      while ( (cqe = msocket_uring_peek_cqe(&uring->ring)) != 0){
+         uint64_t userData = cqe->user_data;
+         int result = cqe->res;
+         msocket_uring_cqe_seen(&uring->ring);
+         uring->inFlight--;
+         msocket_reactor_uringComplete(self, userData, result);
+      }
+      msocket_reactor_runTimers(self);
+      msocket_reactor_freeGarbage(self);
+   }
+   msocket_reactor_uringShutdown(self);
+}
+
+static struct io_uring_sqe *msocket_reactor_uringSqe(msocket_reactor_t *self, msocket_reactor_handle_t *handle, uint32_t op){
+   struct io_uring_sqe *sqe = msocket_uring_get_sqe(&self->uring->ring);
+   if (sqe != 0){
+      sqe->user_data = (uint64_t) (uintptr_t) handle | op;
+      self->uring->inFlight++;
+      if (handle != 0){
+         handle->opsInFlight |= (uint8_t) (1u << op);
+      }
+   }
+   return sqe;
+}
+
+/**
+ * Submits next operation for socket (receive, accept or poll for UDP and pending connect). Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_uringArm(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   struct io_uring_sqe *sqe;
+   msocket_t *msocket = handle->msocket;
+   uint8_t state = (uint8_t) msocket_state(msocket);
+   if ( (msocket->socketMode & MSOCKET_MODE_UDP) != 0 ){
+      sqe = msocket_reactor_uringSqe(self, handle, URING_OP_POLL);
+      if (sqe == 0){
+         return -1;
+      }
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = msocket->udpsockfd;
+      sqe->poll32_events = POLLIN;
+   }
+   else if (state == MSOCKET_STATE_PENDING){
+      sqe = msocket_reactor_uringSqe(self, handle, URING_OP_POLL);
+      if (sqe == 0){
+         return -1;
+      }
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = msocket->tcpsockfd;
+      sqe->poll32_events = POLLOUT; //connect of msocket_connect_async completed
+   }
+   else if (state == MSOCKET_STATE_LISTENING){
+      sqe = msocket_reactor_uringSqe(self, handle, URING_OP_ACCEPT);
+      if (sqe == 0){
+         return -1;
+      }
+      handle->peerAddrLen = (socklen_t) sizeof(handle->peerAddr);
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = msocket->tcpsockfd;
+      sqe->addr = (uint64_t) (uintptr_t) &handle->peerAddr;
+      sqe->addr2 = (uint64_t) (uintptr_t) &handle->peerAddrLen;
+      sqe->accept_flags = SOCK_CLOEXEC;
+   }
+   else{
+      uint32_t recvSize = msocket_ioRecvSize(msocket);
+      if ( (handle->recvBuf == 0) || (handle->recvBufSize != recvSize) ){
+         //no receive is in flight, the kernel does not hold the old buffer
+         uint8_t *recvBuf = (uint8_t*) realloc(handle->recvBuf, recvSize);
+         if (recvBuf == 0){
+            return -1;
+         }
+         handle->recvBuf = recvBuf;
+         handle->recvBufSize = recvSize;
+      }
+      sqe = msocket_reactor_uringSqe(self, handle, URING_OP_RECV);
+      if (sqe == 0){
+         return -1;
+      }
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = msocket->tcpsockfd;
+      sqe->addr = (uint64_t) (uintptr_t) handle->recvBuf;
+      sqe->len = handle->recvBufSize;
+   }
+   return 0;
+}
+
+/**
+ * Submits the head of the send queue as one IORING_OP_SENDMSG of up to URING_SEND_IOV_MAX queue items. A file at the
+ * head of the queue is polled for instead, msocket_ioWritable sends it with sendfile. Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_uringArmWrite(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   struct io_uring_sqe *sqe;
+   int iovcnt = 0;
+   if ( (handle->opsInFlight & (1u << URING_OP_WRITE)) != 0u){
+      return 0;
+   }
+   sqe = msocket_reactor_uringSqe(self, handle, URING_OP_WRITE);
+   if (sqe == 0){
+      return -1;
+   }
+   sqe->fd = handle->msocket->tcpsockfd;
+   handle->txItems = msocket_ioSendBegin(handle->msocket, &handle->txIov[0], URING_SEND_IOV_MAX, &iovcnt);
+   if (handle->txItems != 0){
+      memset(&handle->txMsg, 0, sizeof(handle->txMsg));
+      handle->txMsg.msg_iov = &handle->txIov[0];
+      handle->txMsg.msg_iovlen = (size_t) iovcnt;
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->addr = (uint64_t) (uintptr_t) &handle->txMsg;
+      sqe->len = 1u;
+      sqe->msg_flags = MSG_NOSIGNAL;
+   }
+   else{
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->poll32_events = POLLOUT;
+   }
+   return 0;
+}
+
+/**
+ * Waits for MSG_ZEROCOPY completions on the error queue of an established TCP socket. Caller must hold the reactor mutex.
+ */
+static int msocket_reactor_uringArmErrors(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   struct io_uring_sqe *sqe;
+   if ( (handle->opsInFlight & (1u << URING_OP_POLL)) != 0u){
+      return 0;
+   }
+   sqe = msocket_reactor_uringSqe(self, handle, URING_OP_POLL);
+   if (sqe == 0){
+      return -1;
+   }
+   sqe->opcode = IORING_OP_POLL_ADD;
+   sqe->fd = handle->msocket->tcpsockfd;
+   sqe->poll32_events = 0u; //POLLERR and POLLHUP are always reported
+   handle->errPoll = 1u;
+   return 0;
+}
+
+/**
+ * Submits polls for sockets handed over by msocket_reactor_want_write and msocket_reactor_want_errors
+ */
+static void msocket_reactor_uringArmWriters(msocket_reactor_t *self){
+   MUTEX_LOCK(self->mutex);
+   while (self->uring->writers != 0){
+      msocket_reactor_handle_t *handle = self->uring->writers;
+      int result = 0;
+      self->uring->writers = handle->writeNext;
+      handle->writeQueued = 0u;
+      handle->writeNext = (msocket_reactor_handle_t*) 0;
+      if ( (handle->msocket == 0) || (handle->cancelled != 0u) ){
+         continue;
+      }
+      if (msocket_ioSendPending(handle->msocket) != 0u){
+         result = msocket_reactor_uringArmWrite(self, handle);
+      }
+      if ( (result >= 0) && (msocket_ioZerocopyPending(handle->msocket) != 0u) ){
+         result = msocket_reactor_uringArmErrors(self, handle);
+      }
+      if (result < 0){
+         msocket_reactor_unlink(self, handle);
+      }
+   }
+   MUTEX_UNLOCK(self->mutex);
+}
+
+static void msocket_reactor_uringArmWakeup(msocket_reactor_t *self){
+   struct io_uring_sqe *sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_WAKEUP);
+   if (sqe != 0){
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = self->wakeupfd;
+      sqe->poll32_events = POLLIN;
+   }
+}
+
+/**
+ * Submits a timeout operation when the reactor timer expires before the timeout operation already in flight (if any).
+ */
+static void msocket_reactor_uringArmTimeout(msocket_reactor_t *self){
+   msocket_reactor_uring_t *uring = self->uring;
+   struct io_uring_sqe *sqe;
+   int timeout = msocket_reactor_nextTimeout(self);
+   uint32_t due = msocket_timestamp() + (uint32_t) timeout;
+   if ( (timeout < 0) || ( (uring->timeoutsInFlight != 0u) && ( (int32_t) (due - uring->timeoutDue) >= 0) ) ){
+      return;
+   }
+   if (uring->timeoutsInFlight != 0u){
+      sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_CANCEL);
+      if (sqe != 0){
+         sqe->opcode = IORING_OP_ASYNC_CANCEL;
+         sqe->addr = URING_OP_TIMEOUT;
+      }
+   }
+   sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_TIMEOUT);
+   if (sqe != 0){
+      uring->timeout.tv_sec = timeout / 1000;
+      uring->timeout.tv_nsec = (long long) (timeout % 1000) * 1000000;
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->addr = (uint64_t) (uintptr_t) &uring->timeout;
+      sqe->len = 1u;
+      uring->timeoutDue = due;
+      uring->timeoutsInFlight++;
+   }
+}
+
+static void msocket_reactor_uringComplete(msocket_reactor_t *self, uint64_t userData, int result){
+   msocket_reactor_handle_t *handle = (msocket_reactor_handle_t*) (uintptr_t) (userData & ~((uint64_t) URING_OP_MASK));
+   uint32_t op = (uint32_t) (userData & URING_OP_MASK);
+   msocket_t *msocket;
+   struct msocket_txitem_tag *txItems = (struct msocket_txitem_tag*) 0;
+   uint8_t errPoll = 0u;
+   if (handle == 0){
+      if (op == URING_OP_WAKEUP){
+         uint64_t value;
+         ssize_t rc = read(self->wakeupfd, &value, sizeof(value));
+         (void) rc;
+         msocket_reactor_uringArmWakeup(self);
+      }
+      else if (op == URING_OP_TIMEOUT){
+         self->uring->timeoutsInFlight--;
+      }
+      return;
+   }
+   MUTEX_LOCK(self->mutex);
+   handle->opsInFlight &= (uint8_t) ~(1u << op);
+   msocket = handle->msocket;
+   if (op == URING_OP_POLL){
+      errPoll = handle->errPoll;
+      handle->errPoll = 0u;
+   }
+   else if (op == URING_OP_WRITE){
+      txItems = handle->txItems;
+      handle->txItems = (struct msocket_txitem_tag*) 0;
+   }
+   if (msocket == 0){
+      MUTEX_UNLOCK(self->mutex);
+      msocket_ioSendRelease(txItems); //the kernel no longer references them
+      return; //detached, handle is freed by msocket_reactor_freeGarbage
+   }
+   self->current = msocket;
+   MUTEX_UNLOCK(self->mutex);
+   switch(op){
+   case URING_OP_RECV:
+      if (result < 0){
+         errno = -result;
+         result = -1;
+      }
+      else if ((uint32_t) result == handle->recvBufSize){
+         msocket_ioRecvFull(msocket);
+      }
+      result = msocket_ioReceived(msocket, handle->recvBuf, result);
+      break;
+   case URING_OP_ACCEPT:
+      if (result >= 0){
+         (void) msocket_ioAccepted(msocket, (SOCKET_T) result, (const struct sockaddr*) &handle->peerAddr);
+      }
+      result = (msocket_state(msocket) == MSOCKET_STATE_CLOSING)? -1 : 0;
+      break;
+   case URING_OP_POLL:
+      if (errPoll != 0u){
+         result = msocket_ioErrQueue(msocket);
+      }
+      else{
+         result = msocket_ioReadable(msocket, self->recvBuf, MSOCKET_IO_BUF_SIZE);
+      }
+      break;
+   case URING_OP_WRITE:
+      result = (txItems != 0)? msocket_ioSendComplete(msocket, txItems, result) : msocket_ioWritable(msocket);
+      break;
+   default:
+      result = 0;
+   }
+   MUTEX_LOCK(self->mutex);
+   self->current = (msocket_t*) 0;
+   if (op == URING_OP_WRITE){
+      if (result > 0){
+         result = msocket_reactor_uringArmWrite(self, handle); //more data queued than the socket took
+      }
+   }
+   else if (errPoll != 0u){
+      if ( (result >= 0) && (msocket_ioZerocopyPending(msocket) != 0u) ){
+         result = msocket_reactor_uringArmErrors(self, handle);
+      }
+   }
+   else if ( (result >= 0) && (op == URING_OP_RECV) ){
+      result = msocket_reactor_updateRead(self, handle); //next receive waits for the backlog and for msocket_resume_read
+   }
+   else if (result >= 0){
+      result = msocket_reactor_uringArm(self, handle);
+      if ( (result >= 0) && (op == URING_OP_POLL) && (msocket_ioSendPending(msocket) != 0u) ){
+         result = msocket_reactor_uringArmWrite(self, handle); //data was queued while connecting
+      }
+   }
+   if (result < 0){
+      msocket_reactor_unlink(self, handle);
+   }
+   pthread_cond_broadcast(&self->cond);
+   MUTEX_UNLOCK(self->mutex);
+}
+
+static void msocket_reactor_uringCancel(msocket_reactor_t *self, msocket_reactor_handle_t *handle){
+   uint32_t op;
+   if (handle->cancelled != 0u){
+      return;
+   }
+   handle->cancelled = 1u;
+   for (op = URING_OP_RECV; op <= URING_OP_WRITE; op++){
+      if ( (handle->opsInFlight & (1u << op)) != 0u){
+         struct io_uring_sqe *sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_CANCEL);
+         if (sqe != 0){
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uint64_t) (uintptr_t) handle | op;
+         }
+      }
+   }
+}
+
+/**
+ * Cancels all operations and waits for their completions, making sure the kernel no longer references any handle memory.
+ */
+static void msocket_reactor_uringShutdown(msocket_reactor_t *self){
+   msocket_reactor_uring_t *uring = self->uring;
+   msocket_reactor_handle_t *handle;
+   struct io_uring_sqe *sqe;
+   MUTEX_LOCK(self->mutex);
+   for (handle = self->handles; handle != 0; handle = handle->next){
+      msocket_reactor_uringCancel(self, handle);
+   }
+   MUTEX_UNLOCK(self->mutex);
+   for (handle = uring->zombies; handle != 0; handle = handle->next){
+      msocket_reactor_uringCancel(self, handle);
+   }
+   sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_CANCEL);
+   if (sqe != 0){
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = URING_OP_WAKEUP;
+   }
+   while (uring->timeoutsInFlight > 0u){
+      sqe = msocket_reactor_uringSqe(self, (msocket_reactor_handle_t*) 0, URING_OP_CANCEL);
+      if (sqe != 0){
+         sqe->opcode = IORING_OP_ASYNC_CANCEL;
+         sqe->addr = URING_OP_TIMEOUT;
+      }
+      uring->timeoutsInFlight--;
+   }
+   while (uring->inFlight > 0u){
+      struct io_uring_cqe *cqe;
+      if ( (msocket_uring_submit(&uring->ring, 1u) < 0) && (errno != EINTR) && (errno != EBUSY) && (errno != EAGAIN) ){
+         break;
+      }
+      while ( (cqe = msocket_uring_peek_cqe(&uring->ring)) != 0){
+         uint64_t userData = cqe->user_data;
+         int result = cqe->res;
+         msocket_uring_cqe_seen(&uring->ring);
+         uring->inFlight--;
+         handle = (msocket_reactor_handle_t*) (uintptr_t) (userData & ~((uint64_t) URING_OP_MASK));
+         if (handle != 0){
+            handle->opsInFlight &= (uint8_t) ~(1u << (userData & URING_OP_MASK));
+            if ( ( (userData & URING_OP_MASK) == URING_OP_WRITE) && (handle->txItems != 0) ){
+               MUTEX_LOCK(self->mutex);
+               if (handle->msocket != 0){
+                  (void) msocket_ioSendComplete(handle->msocket, handle->txItems, result); //unsent data returns to the queue
+               }
+               else{
+                  msocket_ioSendRelease(handle->txItems);
+               }
+               handle->txItems = (struct msocket_txitem_tag*) 0;
+               MUTEX_UNLOCK(self->mutex);
+            }
+         }
+      }
+   }
+   while (uring->zombies != 0){
+      handle = uring->zombies;
+      uring->zombies = handle->next;
+      msocket_reactor_freeHandle(handle);
+   }
+}
+
+#endif //MSOCKET_IO_URING
+
+#endif //__linux__
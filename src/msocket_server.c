@@ -17,6 +17,9 @@
 #include <string.h>
 #include "osmacro.h"
 #include "osutil.h"
+#ifdef __linux__
+#include "msocket_reactor.h"
+#endif
 
 #ifdef _WIN32
 #include <process.h>
@@ -31,10 +34,25 @@
 
 #define CLEANUP_INTERVAL_MS 200
 
+#ifdef __linux__
+typedef struct msocket_server_shard_tag{
+   msocket_server_t *parent;
+   msocket_reactor_t reactor;
+   msocket_t *tcpSocket;
+   msocket_t *udpSocket;
+}msocket_server_shard_t;
+#endif
 
 /**************** Private Function Declarations *******************/
-static void msocket_server_start_threads(msocket_server_t *self);
-static THREAD_PROTO(acceptTask,arg);
+static int8_t msocket_server_start_classic(msocket_server_t *self);
+static int8_t msocket_server_listen(msocket_server_t *self);
+static void msocket_server_start_cleanup(msocket_server_t *self);
+static void msocket_server_accept(void *arg, struct msocket_server_tag *srv, msocket_t *child);
+#ifdef __linux__
+static int8_t msocket_server_start_shards_internal(msocket_server_t *self, uint32_t numShards);
+static void msocket_server_stop_shards(msocket_server_t *self);
+static void msocket_server_shard_accept(void *arg, struct msocket_server_tag *srv, msocket_t *child);
+#endif
 static THREAD_PROTO(cleanupTask,arg);
 /**************** Private Variable Declarations *******************/
 
@@ -47,7 +65,15 @@ void msocket_server_create(msocket_server_t *self, uint8_t addressFamily, void (
       self->udpAddr=0;
       self->socketPath=0;
       self->acceptSocket = 0;
+      self->udpSocket = 0;
       self->cleanupStop = 0;
+      self->shards = 0;
+      self->numShards = 0u;
+      self->reactorBackend = MSOCKET_SERVER_BACKEND_DEFAULT;
+      self->backlog = MSOCKET_DEFAULT_BACKLOG;
+#ifndef _WIN32
+      self->workpool = (struct msocket_workpool_tag*) 0;
+#endif
       memset(&self->handlerTable,0,sizeof(self->handlerTable));
       self->handlerArg = 0;
       self->addressFamily = addressFamily;
@@ -60,6 +86,7 @@ void msocket_server_create(msocket_server_t *self, uint8_t addressFamily, void (
          self->pDestructor = msocket_vdelete;
       }
       msocket_ary_create(&self->cleanupItems,0);
+      msocket_group_create(&self->connections);
       MUTEX_INIT(self->mutex);
       SEMAPHORE_CREATE(self->sem);
    }
@@ -72,21 +99,22 @@ void msocket_server_destroy(msocket_server_t *self){
 
    if(self != 0){
       msocket_t *acceptSocket;
+      msocket_t *udpSocket;
+#ifdef __linux__
+      msocket_server_stop_shards(self);
+#endif
       MUTEX_LOCK(self->mutex);
       self->cleanupStop = 1;
       acceptSocket = self->acceptSocket;
+      udpSocket = self->udpSocket;
+      self->acceptSocket = (msocket_t*) 0;
+      self->udpSocket = (msocket_t*) 0;
+      MUTEX_UNLOCK(self->mutex);
       if(acceptSocket != 0){
-         msocket_close(acceptSocket);
-         MUTEX_UNLOCK(self->mutex);
-#ifdef _WIN32
-         WaitForSingleObject( self->acceptThread, INFINITE );
-         CloseHandle( self->acceptThread );
-#else
-         pthread_join(self->acceptThread,&result);
-#endif
+         msocket_delete(acceptSocket); //waits for its I/O thread, no connections are accepted after this
       }
-      else {
-         MUTEX_UNLOCK(self->mutex);
+      if(udpSocket != 0){
+         msocket_delete(udpSocket);
       }
       if (self->pDestructor != 0) {
 #ifdef _WIN32
@@ -97,6 +125,7 @@ void msocket_server_destroy(msocket_server_t *self){
 #endif
       }
       msocket_ary_destroy(&self->cleanupItems);
+      msocket_group_destroy(&self->connections);
       SEMAPHORE_DESTROY(self->sem);
       MUTEX_DESTROY(self->mutex);
       if(self->udpAddr != 0){
@@ -135,15 +164,67 @@ void msocket_server_sethandler(msocket_server_t *self, const msocket_handler_t *
    }
 }
 
+/**
+ * Selects the I/O backend used by shard reactors (see msocket_reactor_set_backend). Must be called before msocket_server_start_shards.
+ */
+void msocket_server_set_reactor_backend(msocket_server_t *self, uint8_t backend){
+   if(self != 0){
+      self->reactorBackend = backend;
+   }
+}
+
+/**
+ * Sets backlog of the listening sockets (see msocket_set_backlog). Must be called before the server is started.
+ */
+void msocket_server_set_backlog(msocket_server_t *self, int backlog){
+   if(self != 0){
+      self->backlog = (backlog > 0)? backlog : MSOCKET_DEFAULT_BACKLOG;
+   }
+}
+
+#ifndef _WIN32
+/**
+ * Accepted connections get workpool set (see msocket_set_workpool) before they are handed to tcp_accept.
+ */
+void msocket_server_set_workpool(msocket_server_t *self, struct msocket_workpool_tag *workpool){
+   if(self != 0){
+      self->workpool = workpool;
+   }
+}
+#endif
+
 void msocket_server_start(msocket_server_t *self,const char *udpAddr,uint16_t udpPort,uint16_t tcpPort){
+   (void) msocket_server_start_shards(self, udpAddr, udpPort, tcpPort, 0u);
+}
+
+/**
+ * numShards=0 starts the classic server where a listener served by msocket_start_io hands out connections which each get their own ioThread.
+ * numShards>0 starts that many reactor threads (Linux only), each one accepting connections on its own SO_REUSEPORT listening socket.
+ * Accepted sockets are served by the reactor that accepted them for their entire lifetime.
+ * Use MSOCKET_SERVER_SHARDS_AUTO to start one shard per online CPU core.
+ */
+int8_t msocket_server_start_shards(msocket_server_t *self, const char *udpAddr, uint16_t udpPort, uint16_t tcpPort, uint32_t numShards){
    if(self != 0){
       self->tcpPort = tcpPort;
       self->udpPort = udpPort;
       if(udpAddr != 0){
          self->udpAddr = strdup(udpAddr);
       }
-      msocket_server_start_threads(self);
+#ifdef __linux__
+      if (numShards != 0u){
+         if (numShards == MSOCKET_SERVER_SHARDS_AUTO){
+            long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+            numShards = (numCores > 0)? (uint32_t) numCores : 1u;
+         }
+         return msocket_server_start_shards_internal(self, numShards);
+      }
+#else
+      (void) numShards;
+#endif
+      return msocket_server_start_classic(self);
    }
+   errno = EINVAL;
+   return -1;
 }
 
 void msocket_server_unix_start(msocket_server_t *self,const char *socketPath) {
@@ -173,7 +254,7 @@ void msocket_server_unix_start(msocket_server_t *self,const char *socketPath) {
             unlink(socketPath);
          }
       }
-      msocket_server_start_threads(self);
+      (void) msocket_server_start_classic(self);
    }
 #else
    (void)self;
@@ -199,14 +280,107 @@ void msocket_server_cleanup_connection(msocket_server_t *self, void *arg){
 
 
 
+/**
+ * Sends buf to all accepted connections that are still open, without copying it per connection.
+ * Returns number of connections buf was sent or queued to. The caller keeps its own reference to buf.
+ */
+uint32_t msocket_server_broadcast(msocket_server_t *self, msocket_buf_t *buf){
+   if (self != 0){
+      return msocket_group_send_buf(&self->connections, buf);
+   }
+   return 0u;
+}
+
+/**
+ * Returns number of accepted connections that have not yet been deleted
+ */
+uint32_t msocket_server_num_connections(msocket_server_t *self){
+   if (self != 0){
+      return msocket_group_num_sockets(&self->connections);
+   }
+   return 0u;
+}
+
 /***************** Private Function Definitions *******************/
 
-static void msocket_server_start_threads(msocket_server_t *self) {
-#ifdef _WIN32
-   THREAD_CREATE(self->acceptThread,acceptTask,(void*) self,self->acceptThreadId);
-#else
-   THREAD_CREATE(self->acceptThread,acceptTask,(void*) self);
+static int8_t msocket_server_start_classic(msocket_server_t *self) {
+   int8_t rc = msocket_server_listen(self);
+   msocket_server_start_cleanup(self);
+   return rc;
+}
+
+/**
+ * Opens the sockets of the classic server. The TCP (or Unix domain) listener is served by msocket_start_io, which drains
+ * the accept queue in batches on each readiness event and passes every new connection to msocket_server_accept.
+ * UDP uses a socket of its own since an I/O thread serves either UDP or TCP of a socket.
+ */
+static int8_t msocket_server_listen(msocket_server_t *self) {
+   msocket_handler_t handler;
+   if (self->udpPort != 0) {
+      memset(&handler, 0, sizeof(handler));
+      handler.udp_msg = self->handlerTable.udp_msg;
+      handler.udp_msg_batch = self->handlerTable.udp_msg_batch;
+      self->udpSocket = msocket_new(self->addressFamily);
+      if (self->udpSocket == 0) {
+         return -1;
+      }
+      msocket_set_handler(self->udpSocket, &handler, self->handlerArg);
+      if (msocket_listen(self->udpSocket, MSOCKET_MODE_UDP, self->udpPort, self->udpAddr) < 0) {
+         printf("*** WARNING: failed to bind to UDP port %d ***\n",self->udpPort);
+         return -1;
+      }
+   }
+   if ( (self->tcpPort != 0) || (self->socketPath != 0) ) {
+      int8_t rc;
+      memset(&handler, 0, sizeof(handler));
+      handler.tcp_accept = msocket_server_accept;
+      self->acceptSocket = msocket_new(self->addressFamily);
+      if (self->acceptSocket == 0) {
+         return -1;
+      }
+      msocket_set_backlog(self->acceptSocket, self->backlog);
+      msocket_set_handler(self->acceptSocket, &handler, self);
+#ifndef _WIN32
+      if (self->socketPath != 0) {
+         rc = msocket_unix_listen(self->acceptSocket, self->socketPath);
+         if (rc < 0) {
+            printf("*** WARNING: failed to bind to path %s ***\n",self->socketPath);
+            return -1;
+         }
+      }
+      else
 #endif
+      {
+         rc = msocket_listen(self->acceptSocket, MSOCKET_MODE_TCP, self->tcpPort, 0);
+         if (rc < 0) {
+            printf("*** WARNING: failed to bind to TCP port %d ***\n",self->tcpPort);
+            return -1;
+         }
+      }
+      return msocket_start_io(self->acceptSocket);
+   }
+   return 0;
+}
+
+/**
+ * Registers a connection accepted by the classic server (or by a shard) and passes it on to the server's tcp_accept
+ */
+static void msocket_server_accept(void *arg, struct msocket_server_tag *srv, msocket_t *child) {
+   msocket_server_t *self = (msocket_server_t*) arg;
+   (void) srv;
+#ifndef _WIN32
+   msocket_set_workpool(child, self->workpool);
+#endif
+   msocket_group_add(&self->connections, child);
+   if (self->handlerTable.tcp_accept != 0) {
+      self->handlerTable.tcp_accept(self->handlerArg, self, child);
+   }
+   else {
+      msocket_delete(child);
+   }
+}
+
+static void msocket_server_start_cleanup(msocket_server_t *self) {
    //User can disable cleanup by explicitly calling msocket_server_disable_cleanup() before calling start. User then has to do cleanup manually.
    if (self->pDestructor != 0) {
 #ifdef _WIN32
@@ -217,71 +391,107 @@ static void msocket_server_start_threads(msocket_server_t *self) {
    }
 }
 
-THREAD_PROTO(acceptTask,arg){
-   msocket_server_t *self = (msocket_server_t *) arg;
-   if(self != 0){
-
-      msocket_handler_t handler;
-      memset(&handler,0,sizeof(handler));
-      self->acceptSocket = msocket_new(self->addressFamily);
-
-      if( (self->acceptSocket != 0) ){
-         int rc;
-         if(self->udpPort != 0){
-            rc = msocket_listen(self->acceptSocket,MSOCKET_MODE_UDP,self->udpPort,self->udpAddr);
-            if(rc<0){
-               printf("*** WARNING: failed to bind to UDP port %d ***\n",self->udpPort);
-               THREAD_RETURN(rc);
-            }
-
+#ifdef __linux__
+static int8_t msocket_server_start_shards_internal(msocket_server_t *self, uint32_t numShards) {
+   uint32_t i;
+   msocket_handler_t tcpHandler;
+   msocket_handler_t udpHandler;
+   self->shards = (msocket_server_shard_t*) calloc(numShards, sizeof(msocket_server_shard_t));
+   if (self->shards == 0) {
+      errno = ENOMEM;
+      return -1;
+   }
+   memset(&tcpHandler, 0, sizeof(tcpHandler));
+   tcpHandler.tcp_accept = msocket_server_shard_accept;
+   memset(&udpHandler, 0, sizeof(udpHandler));
+   udpHandler.udp_msg = self->handlerTable.udp_msg;
+   udpHandler.udp_msg_batch = self->handlerTable.udp_msg_batch;
+   for (i = 0u; i < numShards; i++) {
+      msocket_server_shard_t *shard = &self->shards[i];
+      shard->parent = self;
+      if (msocket_reactor_create(&shard->reactor) != 0) {
+         break;
+      }
+      self->numShards++;
+      if ( (self->reactorBackend != MSOCKET_SERVER_BACKEND_DEFAULT) &&
+           (msocket_reactor_set_backend(&shard->reactor, self->reactorBackend) != 0) ) {
+         break;
+      }
+      if (msocket_reactor_start(&shard->reactor) != 0) {
+         break;
+      }
+      if (self->tcpPort != 0) {
+         shard->tcpSocket = msocket_new(self->addressFamily);
+         if (shard->tcpSocket == 0) {
+            break;
          }
-         if(self->tcpPort != 0){
-            rc = msocket_listen(self->acceptSocket,MSOCKET_MODE_TCP,self->tcpPort,0);
-            if(rc<0){
-               printf("*** WARNING: failed to bind to TCP port %d ***\n",self->tcpPort);
-               THREAD_RETURN(rc);
-            }
+         msocket_set_reuse_port(shard->tcpSocket, 1u);
+         msocket_set_backlog(shard->tcpSocket, self->backlog);
+         msocket_set_reactor(shard->tcpSocket, &shard->reactor);
+         msocket_set_handler(shard->tcpSocket, &tcpHandler, (void*) shard);
+         if (msocket_listen(shard->tcpSocket, MSOCKET_MODE_TCP, self->tcpPort, 0) < 0) {
+            printf("*** WARNING: failed to bind to TCP port %d ***\n",self->tcpPort);
+            break;
          }
-#ifndef _WIN32
-         if (self->socketPath != 0)
-         {
-            rc = msocket_unix_listen(self->acceptSocket,self->socketPath);
-            if(rc<0){
-               printf("*** WARNING: failed to bind to path %s ***\n",self->socketPath);
-               THREAD_RETURN(rc);
-            }
+         if (msocket_start_io(shard->tcpSocket) != 0) {
+            break;
          }
-#endif
-         while(1){
-            msocket_t *child;
-#ifdef MSOCKET_DEBUG
-            printf("[MSOCKET] accept wait\n");
-#endif
-            child = msocket_accept(self->acceptSocket, 0);
-#ifdef MSOCKET_DEBUG
-            printf("[MSOCKET] accept return\n");
-#endif
-            if( child == 0 ){
-               break;
-            }
-            else{
-               if(self->handlerTable.tcp_accept != 0){
-                  self->handlerTable.tcp_accept(self->handlerArg, self, child);
-               }
-            }
+      }
+      if ( (i == 0u) && (self->udpPort != 0) ) {
+         shard->udpSocket = msocket_new(self->addressFamily);
+         if (shard->udpSocket == 0) {
+            break;
+         }
+         msocket_set_reactor(shard->udpSocket, &shard->reactor);
+         msocket_set_handler(shard->udpSocket, &udpHandler, self->handlerArg);
+         if (msocket_listen(shard->udpSocket, MSOCKET_MODE_UDP, self->udpPort, self->udpAddr) < 0) {
+            printf("*** WARNING: failed to bind to UDP port %d ***\n",self->udpPort);
+            break;
          }
-         MUTEX_LOCK(self->mutex);
-         msocket_delete(self->acceptSocket);
-         self->acceptSocket = (msocket_t*) 0;
-         MUTEX_UNLOCK(self->mutex);
       }
    }
-#ifdef MSOCKET_DEBUG
-   printf("acceptThread exit\n");
-#endif
-   THREAD_RETURN(0);
+   if (i < numShards) {
+      msocket_server_stop_shards(self);
+      return -1;
+   }
+   msocket_server_start_cleanup(self);
+   return 0;
 }
 
+/**
+ * Closes all listening sockets and stops the reactor threads.
+ * Accepted sockets that are still open will no longer be served (they must still be deleted by the application).
+ */
+static void msocket_server_stop_shards(msocket_server_t *self) {
+   uint32_t i;
+   if (self->shards == 0) {
+      return;
+   }
+   for (i = 0u; i < self->numShards; i++) {
+      msocket_server_shard_t *shard = &self->shards[i];
+      if (shard->tcpSocket != 0) {
+         msocket_delete(shard->tcpSocket);
+      }
+      if (shard->udpSocket != 0) {
+         msocket_delete(shard->udpSocket);
+      }
+      msocket_reactor_stop(&shard->reactor);
+   }
+   for (i = 0u; i < self->numShards; i++) {
+      msocket_reactor_destroy(&self->shards[i].reactor);
+   }
+   free(self->shards);
+   self->shards = (msocket_server_shard_t*) 0;
+   self->numShards = 0u;
+}
+
+static void msocket_server_shard_accept(void *arg, struct msocket_server_tag *srv, msocket_t *child) {
+   msocket_server_shard_t *shard = (msocket_server_shard_t*) arg;
+   msocket_set_reactor(child, &shard->reactor); //connection stays on the reactor that accepted it
+   msocket_server_accept(shard->parent, srv, child);
+}
+#endif
+
 THREAD_PROTO(cleanupTask,arg)
 {
    msocket_server_t *self = (msocket_server_t *) arg;
@@ -0,0 +1,216 @@
+/*****************************************************************************
+* \file:    msocket_timer.c
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Hierarchical timer wheel used by the msocket I/O drivers
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+/********************************* Includes **********************************/
+#include <string.h>
+#include "msocket_timer.h"
+
+/**************************** Constants and Types ****************************/
+#define LEVEL_MASK (MSOCKET_TIMER_LEVEL_SIZE - 1u)
+#define MAX_DELTA  ((uint32_t) 1u << (MSOCKET_TIMER_LEVEL_BITS * MSOCKET_TIMER_LEVELS))
+
+/************************* Local Function Prototypes *************************/
+static void msocket_timerwheel_insert(msocket_timerwheel_t *self, msocket_timer_t *timer);
+static void msocket_timerwheel_cascade(msocket_timerwheel_t *self);
+
+/***************************** Exported Functions ****************************/
+
+void msocket_timer_init(msocket_timer_t *timer){
+   if (timer != 0){
+      memset(timer, 0, sizeof(msocket_timer_t));
+   }
+}
+
+uint8_t msocket_timer_is_running(const msocket_timer_t *timer){
+   if ( (timer != 0) && (timer->pprev != 0) ){
+      return 1u;
+   }
+   return 0u;
+}
+
+/**
+ * now is a millisecond timestamp, the same time base must be used in all calls to the wheel.
+ */
+void msocket_timerwheel_create(msocket_timerwheel_t *self, uint32_t now){
+   if (self != 0){
+      memset(self, 0, sizeof(msocket_timerwheel_t));
+      self->current = now;
+   }
+}
+
+/**
+ * Adds (or re-adds) timer to expire at time expires. Timers with expiry time in the past become due on next call to msocket_timerwheel_expire.
+ * ownerList is optional, it links the timer into a list that can be used to remove all timers of one owner.
+ */
+void msocket_timerwheel_add(msocket_timerwheel_t *self, msocket_timer_t *timer, uint32_t expires, msocket_timer_t **ownerList){
+   if ( (self != 0) && (timer != 0) ){
+      msocket_timerwheel_remove(self, timer);
+      timer->expires = expires;
+      msocket_timerwheel_insert(self, timer);
+      self->numTimers++;
+      if (ownerList != 0){
+         timer->ownerNext = *ownerList;
+         if (timer->ownerNext != 0){
+            timer->ownerNext->ownerPprev = &timer->ownerNext;
+         }
+         *ownerList = timer;
+         timer->ownerPprev = ownerList;
+      }
+   }
+}
+
+void msocket_timerwheel_remove(msocket_timerwheel_t *self, msocket_timer_t *timer){
+   if ( (self != 0) && (timer != 0) && (timer->pprev != 0) ){
+      *timer->pprev = timer->next;
+      if (timer->next != 0){
+         timer->next->pprev = timer->pprev;
+      }
+      timer->next = (msocket_timer_t*) 0;
+      timer->pprev = (msocket_timer_t**) 0;
+      if (timer->ownerPprev != 0){
+         *timer->ownerPprev = timer->ownerNext;
+         if (timer->ownerNext != 0){
+            timer->ownerNext->ownerPprev = timer->ownerPprev;
+         }
+         timer->ownerNext = (msocket_timer_t*) 0;
+         timer->ownerPprev = (msocket_timer_t**) 0;
+      }
+      self->numTimers--;
+   }
+}
+
+void msocket_timerwheel_remove_all(msocket_timerwheel_t *self, msocket_timer_t **ownerList){
+   if ( (self != 0) && (ownerList != 0) ){
+      while (*ownerList != 0){
+         msocket_timerwheel_remove(self, *ownerList);
+      }
+   }
+}
+
+/**
+ * Returns next timer that is due at time now (the timer is removed from the wheel), NULL when there are no more due timers.
+ * Cost is O(1) per elapsed tick and expired timer.
+ */
+msocket_timer_t *msocket_timerwheel_expire(msocket_timerwheel_t *self, uint32_t now){
+   if (self == 0){
+      return (msocket_timer_t*) 0;
+   }
+   while(1){
+      uint32_t index;
+      msocket_timer_t *timer = self->expired;
+      if (timer != 0){
+         msocket_timerwheel_remove(self, timer);
+         return timer;
+      }
+      if (self->numTimers == 0u){
+         self->current = now + 1u;
+         break;
+      }
+      if ( (int32_t) (now - self->current) < 0){
+         break;
+      }
+      index = self->current & LEVEL_MASK;
+      if (index == 0u){
+         msocket_timerwheel_cascade(self);
+      }
+      timer = self->slots[0][index];
+      if (timer != 0){
+         self->slots[0][index] = (msocket_timer_t*) 0;
+         self->expired = timer;
+         timer->pprev = &self->expired;
+      }
+      self->current++;
+   }
+   return (msocket_timer_t*) 0;
+}
+
+/**
+ * Returns number of milliseconds from now until msocket_timerwheel_expire needs to be called again.
+ * For timers in the upper levels this is the time when they get cascaded, which is never later than their expiry time.
+ */
+uint32_t msocket_timerwheel_next(msocket_timerwheel_t *self, uint32_t now){
+   uint32_t level;
+   uint32_t due = 0u;
+   uint8_t found = 0u;
+   if ( (self == 0) || (self->numTimers == 0u) ){
+      return MSOCKET_TIMER_INFINITE;
+   }
+   if (self->expired != 0){
+      return 0u;
+   }
+   for (level = 0u; level < MSOCKET_TIMER_LEVELS; level++){
+      uint32_t shift = level * MSOCKET_TIMER_LEVEL_BITS;
+      uint32_t base = self->current >> shift;
+      uint32_t i;
+      //slot of current block is still to be cascaded when current is at its boundary
+      uint32_t first = ( (level == 0u) || ( (self->current & ( (1u << shift) - 1u)) == 0u) )? 0u : 1u;
+      for (i = first; i <= MSOCKET_TIMER_LEVEL_SIZE; i++){
+         if (self->slots[level][(base + i) & LEVEL_MASK] != 0){
+            uint32_t candidate = (base + i) << shift;
+            if ( (found == 0u) || ( (int32_t) (candidate - due) < 0) ){
+               due = candidate;
+               found = 1u;
+            }
+            break;
+         }
+      }
+   }
+   if ( (found == 0u) || ( (int32_t) (due - now) <= 0) ){
+      return 0u;
+   }
+   return due - now;
+}
+
+/****************************** Local Functions ******************************/
+
+static void msocket_timerwheel_insert(msocket_timerwheel_t *self, msocket_timer_t *timer){
+   uint32_t when = timer->expires;
+   uint32_t delta = when - self->current;
+   uint32_t level = 0u;
+   msocket_timer_t **slot;
+   if ( (int32_t) delta < 0){
+      when = self->current;
+      delta = 0u;
+   }
+   else if (delta >= MAX_DELTA){
+      when = self->current + (MAX_DELTA - 1u); //re-inserted when cascaded
+      delta = MAX_DELTA - 1u;
+   }
+   while ( (delta >> ( (level + 1u) * MSOCKET_TIMER_LEVEL_BITS)) != 0u){
+      level++;
+   }
+   slot = &self->slots[level][(when >> (level * MSOCKET_TIMER_LEVEL_BITS)) & LEVEL_MASK];
+   timer->next = *slot;
+   if (timer->next != 0){
+      timer->next->pprev = &timer->next;
+   }
+   *slot = timer;
+   timer->pprev = slot;
+}
+
+/**
+ * Moves timers from upper levels down as time passes their slot boundaries. Called when level 0 wraps around.
+ */
+static void msocket_timerwheel_cascade(msocket_timerwheel_t *self){
+   uint32_t level;
+   for (level = 1u; level < MSOCKET_TIMER_LEVELS; level++){
+      uint32_t index = (self->current >> (level * MSOCKET_TIMER_LEVEL_BITS)) & LEVEL_MASK;
+      msocket_timer_t *timer = self->slots[level][index];
+      self->slots[level][index] = (msocket_timer_t*) 0;
+      while (timer != 0){
+         msocket_timer_t *next = timer->next;
+         msocket_timerwheel_insert(self, timer);
+         timer = next;
+      }
+      if (index != 0u){
+         break;
+      }
+   }
+}
@@ -0,0 +1,184 @@
+/*****************************************************************************
+* \file:    msocket_uring.c
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Minimal io_uring wrapper used by msocket_reactor (Linux only, no liburing dependency)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+/********************************* Includes **********************************/
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "msocket_uring.h"
+
+/**************************** Constants and Types ****************************/
+
+/************************* Local Function Prototypes *************************/
+static int msocket_uring_setup(unsigned entries, struct io_uring_params *params);
+static int msocket_uring_enter(int ringfd, unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+/***************************** Exported Functions ****************************/
+
+/**
+ * Creates a new ring. Returns 0 on success, -1 on failure (errno is set, ENOSYS when kernel lacks io_uring support).
+ */
+int msocket_uring_init(msocket_uring_t *self, unsigned entries){
+   struct io_uring_params params;
+   uint8_t *sqRing;
+   uint8_t *cqRing;
+   memset(self, 0, sizeof(msocket_uring_t));
+   memset(&params, 0, sizeof(params));
+   self->ringfd = msocket_uring_setup(entries, &params);
+   if (self->ringfd < 0){
+      return -1;
+   }
+   if ( (params.features & IORING_FEAT_NODROP) == 0){
+      //completions could get lost on older kernels, better use epoll there
+      close(self->ringfd);
+      errno = ENOSYS;
+      return -1;
+   }
+   self->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   self->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   if (params.features & IORING_FEAT_SINGLE_MMAP){
+      if (self->cqRingSize > self->sqRingSize){
+         self->sqRingSize = self->cqRingSize;
+      }
+      self->cqRingSize = self->sqRingSize;
+   }
+   self->sqRing = mmap(0, self->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->ringfd, IORING_OFF_SQ_RING);
+   if (self->sqRing == MAP_FAILED){
+      close(self->ringfd);
+      return -1;
+   }
+   if (params.features & IORING_FEAT_SINGLE_MMAP){
+      self->cqRing = self->sqRing;
+   }
+   else{
+      self->cqRing = mmap(0, self->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->ringfd, IORING_OFF_CQ_RING);
+      if (self->cqRing == MAP_FAILED){
+         munmap(self->sqRing, self->sqRingSize);
+         close(self->ringfd);
+         return -1;
+      }
+   }
+   self->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+   self->sqes = (struct io_uring_sqe*) mmap(0, self->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, self->ringfd, IORING_OFF_SQES);
+   if (self->sqes == MAP_FAILED){
+      if (self->cqRing != self->sqRing){
+         munmap(self->cqRing, self->cqRingSize);
+      }
+      munmap(self->sqRing, self->sqRingSize);
+      close(self->ringfd);
+      return -1;
+   }
+   sqRing = (uint8_t*) self->sqRing;
+   cqRing = (uint8_t*) self->cqRing;
+   self->sqHead = (unsigned*) (sqRing + params.sq_off.head);
+   self->sqTail = (unsigned*) (sqRing + params.sq_off.tail);
+   self->sqMask = *(unsigned*) (sqRing + params.sq_off.ring_mask);
+   self->sqEntries = *(unsigned*) (sqRing + params.sq_off.ring_entries);
+   self->sqArray = (unsigned*) (sqRing + params.sq_off.array);
+   self->cqHead = (unsigned*) (cqRing + params.cq_off.head);
+   self->cqTail = (unsigned*) (cqRing + params.cq_off.tail);
+   self->cqMask = *(unsigned*) (cqRing + params.cq_off.ring_mask);
+   self->cqes = (struct io_uring_cqe*) (cqRing + params.cq_off.cqes);
+   self->sqeTail = *self->sqTail;
+   self->toSubmit = 0u;
+   return 0;
+}
+
+/**
+ * Closing the ring makes the kernel cancel all requests that are still in flight.
+ */
+void msocket_uring_exit(msocket_uring_t *self){
+   munmap(self->sqes, self->sqesSize);
+   if (self->cqRing != self->sqRing){
+      munmap(self->cqRing, self->cqRingSize);
+   }
+   munmap(self->sqRing, self->sqRingSize);
+   close(self->ringfd);
+}
+
+/**
+ * Returns a zeroed submission queue entry. When the submission queue is full, queued entries are first handed to the kernel.
+ */
+struct io_uring_sqe *msocket_uring_get_sqe(msocket_uring_t *self){
+   struct io_uring_sqe *sqe;
+   unsigned head = __atomic_load_n(self->sqHead, __ATOMIC_ACQUIRE);
+   if ( (self->sqeTail - head) >= self->sqEntries){
+      if (msocket_uring_submit(self, 0u) < 0){
+         return (struct io_uring_sqe*) 0;
+      }
+      head = __atomic_load_n(self->sqHead, __ATOMIC_ACQUIRE);
+      if ( (self->sqeTail - head) >= self->sqEntries){
+         return (struct io_uring_sqe*) 0;
+      }
+   }
+   sqe = &self->sqes[self->sqeTail & self->sqMask];
+   self->sqArray[self->sqeTail & self->sqMask] = self->sqeTail & self->sqMask;
+   self->sqeTail++;
+   self->toSubmit++;
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+   return sqe;
+}
+
+/**
+ * Hands all queued entries to the kernel using a single system call, optionally waiting for waitNr completions.
+ */
+int msocket_uring_submit(msocket_uring_t *self, unsigned waitNr){
+   int result;
+   unsigned toSubmit = self->toSubmit;
+   __atomic_store_n(self->sqTail, self->sqeTail, __ATOMIC_RELEASE);
+   if ( (toSubmit == 0u) && (waitNr == 0u) ){
+      return 0;
+   }
+   result = msocket_uring_enter(self->ringfd, toSubmit, waitNr, (waitNr > 0u)? IORING_ENTER_GETEVENTS : 0u);
+   if (result >= 0){
+      self->toSubmit -= (unsigned) result;
+   }
+   return result;
+}
+
+struct io_uring_cqe *msocket_uring_peek_cqe(msocket_uring_t *self){
+   unsigned head = *self->cqHead;
+   if (head != __atomic_load_n(self->cqTail, __ATOMIC_ACQUIRE)){
+      return &self->cqes[head & self->cqMask];
+   }
+   return (struct io_uring_cqe*) 0;
+}
+
+void msocket_uring_cqe_seen(msocket_uring_t *self){
+   __atomic_store_n(self->cqHead, *self->cqHead + 1u, __ATOMIC_RELEASE);
+}
+
+/****************************** Local Functions ******************************/
+
+static int msocket_uring_setup(unsigned entries, struct io_uring_params *params){
+#ifdef __NR_io_uring_setup
+   return (int) syscall(__NR_io_uring_setup, entries, params);
+#else
+   (void) entries;
+   (void) params;
+   errno = ENOSYS;
+   return -1;
+#endif
+}
+
+static int msocket_uring_enter(int ringfd, unsigned toSubmit, unsigned minComplete, unsigned flags){
+#ifdef __NR_io_uring_enter
+   return (int) syscall(__NR_io_uring_enter, ringfd, toSubmit, minComplete, flags, (void*) 0, 0);
+#else
+   (void) ringfd;
+   (void) toSubmit;
+   (void) minComplete;
+   (void) flags;
+   errno = ENOSYS;
+   return -1;
+#endif
+}
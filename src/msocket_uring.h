@@ -0,0 +1,60 @@
+/*****************************************************************************
+* \file:    msocket_uring.h
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Minimal io_uring wrapper used by msocket_reactor (Linux only, no liburing dependency)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef MSOCKET_URING_H
+#define MSOCKET_URING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********************************* Includes **********************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**************************** Constants and Types ****************************/
+
+#define MSOCKET_URING_DEFAULT_ENTRIES 256u
+
+typedef struct msocket_uring_tag{
+   int ringfd;
+   void *sqRing;
+   void *cqRing;
+   struct io_uring_sqe *sqes;
+   size_t sqRingSize;
+   size_t cqRingSize;
+   size_t sqesSize;
+   unsigned *sqHead;
+   unsigned *sqTail;
+   unsigned *sqArray;
+   unsigned sqMask;
+   unsigned sqEntries;
+   unsigned *cqHead;
+   unsigned *cqTail;
+   struct io_uring_cqe *cqes;
+   unsigned cqMask;
+   unsigned sqeTail; //local tail, published to the kernel in msocket_uring_submit
+   unsigned toSubmit;
+}msocket_uring_t;
+
+/********************************* Functions *********************************/
+int msocket_uring_init(msocket_uring_t *self, unsigned entries);
+void msocket_uring_exit(msocket_uring_t *self);
+struct io_uring_sqe *msocket_uring_get_sqe(msocket_uring_t *self);
+int msocket_uring_submit(msocket_uring_t *self, unsigned waitNr);
+struct io_uring_cqe *msocket_uring_peek_cqe(msocket_uring_t *self);
+void msocket_uring_cqe_seen(msocket_uring_t *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MSOCKET_URING_H
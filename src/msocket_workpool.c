@@ -0,0 +1,358 @@
+/*****************************************************************************
+* \file:    msocket_workpool.c
+* \author:  Conny Gustafsson
+* \date:    2026-10-17
+* \brief:   Fixed pool of worker threads running tcp_data/tcp_disconnected callbacks (Linux/Unix only)
+*
+* Copyright (c) 2026 Conny Gustafsson
+*
+******************************************************************************/
+
+#ifndef _WIN32
+#include <errno.h>
+#include <string.h>
+#include <malloc.h>
+#include <assert.h>
+#include "msocket_workpool.h"
+#include "msocket_internal.h"
+
+/****************** Constants and Types ***************************/
+
+#define WORK_STATE_IDLE     0u //no queued work
+#define WORK_STATE_QUEUED   1u //in run queue, waiting for a worker
+#define WORK_STATE_RUNNING  2u //a worker is processing the socket
+
+typedef struct msocket_workitem_tag{
+   struct msocket_workitem_tag *next;
+   uint32_t len; //0 means the peer disconnected, MSOCKET_WORK_RESUME that reading was resumed
+   uint8_t data[];
+}msocket_workitem_t;
+
+/**************** Private Function Declarations *******************/
+static THREAD_PROTO(workerTask,arg);
+static void msocket_workpool_stop(msocket_workpool_t *self);
+static void msocket_workpool_runnable(msocket_workpool_t *self, msocket_t *msocket);
+static void msocket_workpool_unrun(msocket_workpool_t *self, msocket_t *msocket);
+static uint32_t msocket_workpool_freeItems(msocket_t *msocket);
+static uint8_t msocket_workpool_takeResume(msocket_t *msocket);
+
+/****************** Public Function Definitions *******************/
+
+/**
+ * numThreads=0 creates MSOCKET_WORKPOOL_DEFAULT_THREADS workers.
+ */
+int8_t msocket_workpool_create(msocket_workpool_t *self, uint32_t numThreads){
+   if ( (self != 0) && (numThreads <= MSOCKET_WORKPOOL_MAX_THREADS) ){
+      if (numThreads == 0u){
+         numThreads = MSOCKET_WORKPOOL_DEFAULT_THREADS;
+      }
+      self->runHead = (msocket_t*) 0;
+      self->runTail = (msocket_t*) 0;
+      self->numThreads = 0u;
+      self->numRunnable = 0u;
+      self->queueDepth = 0u;
+      self->maxQueueDepth = 0u;
+      self->numProcessed = 0u;
+      self->stopRequest = 0u;
+      self->threads = (THREAD_T*) malloc(sizeof(THREAD_T) * numThreads);
+      if (self->threads == 0){
+         errno = ENOMEM;
+         return -1;
+      }
+      MUTEX_INIT(self->mutex);
+      pthread_cond_init(&self->cond, 0);
+      pthread_cond_init(&self->idle, 0);
+      for (; self->numThreads < numThreads; self->numThreads++){
+         int rc = THREAD_CREATE(self->threads[self->numThreads], workerTask, self);
+         if (rc != 0){
+            msocket_workpool_destroy(self);
+            errno = rc;
+            return -1;
+         }
+      }
+      return 0;
+   }
+   errno = EINVAL;
+   return -1;
+}
+
+/**
+ * Stops all workers. Sockets using the pool must be closed before the pool is destroyed.
+ */
+void msocket_workpool_destroy(msocket_workpool_t *self){
+   if (self != 0){
+      msocket_workpool_stop(self);
+      MUTEX_LOCK(self->mutex);
+      while (self->runHead != 0){
+         msocket_t *msocket = self->runHead;
+         msocket_workpool_unrun(self, msocket);
+         self->queueDepth -= msocket_workpool_freeItems(msocket);
+      }
+      MUTEX_UNLOCK(self->mutex);
+      free(self->threads);
+      pthread_cond_destroy(&self->idle);
+      pthread_cond_destroy(&self->cond);
+      MUTEX_DESTROY(self->mutex);
+   }
+}
+
+msocket_workpool_t *msocket_workpool_new(uint32_t numThreads){
+   msocket_workpool_t *self = (msocket_workpool_t*) malloc(sizeof(msocket_workpool_t));
+   if (self != 0){
+      int8_t rc = msocket_workpool_create(self, numThreads);
+      if (rc != 0){
+         free(self);
+         self = (msocket_workpool_t*) 0;
+      }
+   }
+   return self;
+}
+
+void msocket_workpool_delete(msocket_workpool_t *self){
+   if (self != 0){
+      msocket_workpool_destroy(self);
+      free(self);
+   }
+}
+
+/**
+ * Returns number of work items (received chunks and disconnect events) that are waiting for or being processed by workers.
+ */
+uint32_t msocket_workpool_queue_depth(msocket_workpool_t *self){
+   uint32_t retval = 0u;
+   if (self != 0){
+      MUTEX_LOCK(self->mutex);
+      retval = self->queueDepth;
+      MUTEX_UNLOCK(self->mutex);
+   }
+   return retval;
+}
+
+void msocket_workpool_get_stats(msocket_workpool_t *self, msocket_workpool_stats_t *stats){
+   if ( (self != 0) && (stats != 0) ){
+      MUTEX_LOCK(self->mutex);
+      stats->numThreads = self->numThreads;
+      stats->queueDepth = self->queueDepth;
+      stats->maxQueueDepth = self->maxQueueDepth;
+      stats->numRunnable = self->numRunnable;
+      stats->numProcessed = self->numProcessed;
+      MUTEX_UNLOCK(self->mutex);
+   }
+}
+
+/**
+ * Queues a copy of data for processing by msocket_ioWork on a worker thread. len=0 queues the disconnect event,
+ * data=NULL with len=MSOCKET_WORK_RESUME the resume event of msocket_resume_read.
+ * Called by the I/O driver of msocket.
+ */
+int8_t msocket_workpool_post(msocket_workpool_t *self, msocket_t *msocket, const uint8_t *data, uint32_t len){
+   msocket_workitem_t *item = (msocket_workitem_t*) malloc(sizeof(msocket_workitem_t) + ( (data != 0)? len : 0u) );
+   if (item == 0){
+      errno = ENOMEM;
+      return -1;
+   }
+   item->next = (msocket_workitem_t*) 0;
+   item->len = len;
+   if ( (data != 0) && (len > 0u) ){
+      memcpy(&item->data[0], data, len);
+   }
+   MUTEX_LOCK(self->mutex);
+   if ( (msocket->workHeld != 0u) && (data == 0) && (len == MSOCKET_WORK_RESUME) ){
+      //delivers what is left in tcpRxBuf before the chunk that did not fit into it
+      item->next = msocket->workHead;
+      msocket->workHead = item;
+      msocket->workHeld = 0u;
+   }
+   else if (msocket->workTail == 0){
+      msocket->workHead = item;
+      msocket->workTail = item;
+   }
+   else{
+      msocket->workTail->next = item;
+      msocket->workTail = item;
+   }
+   if (++self->queueDepth > self->maxQueueDepth){
+      self->maxQueueDepth = self->queueDepth;
+   }
+   if ( (msocket->workState == WORK_STATE_IDLE) && (msocket->workHeld == 0u) ){
+      msocket_workpool_runnable(self, msocket);
+   }
+   MUTEX_UNLOCK(self->mutex);
+   return 0;
+}
+
+/**
+ * Discards work queued for msocket and waits until no worker is processing it.
+ * Must not be called from a worker currently processing msocket (see msocket_workpool_is_worker).
+ */
+void msocket_workpool_cancel(msocket_workpool_t *self, msocket_t *msocket){
+   MUTEX_LOCK(self->mutex);
+   self->queueDepth -= msocket_workpool_freeItems(msocket);
+   if (msocket->workState == WORK_STATE_QUEUED){
+      msocket_workpool_unrun(self, msocket);
+   }
+   while (msocket->workState == WORK_STATE_RUNNING){
+      pthread_cond_wait(&self->idle, &self->mutex);
+   }
+   MUTEX_UNLOCK(self->mutex);
+}
+
+/**
+ * Returns 1 when called from the worker currently processing msocket
+ */
+uint8_t msocket_workpool_is_worker(msocket_workpool_t *self, msocket_t *msocket){
+   uint8_t retval = 0u;
+   MUTEX_LOCK(self->mutex);
+   if ( (msocket->workState == WORK_STATE_RUNNING) && (pthread_equal(msocket->workThread, pthread_self()) != 0) ){
+      retval = 1u;
+   }
+   MUTEX_UNLOCK(self->mutex);
+   return retval;
+}
+
+/***************** Private Function Definitions *******************/
+
+static THREAD_PROTO(workerTask,arg){
+   msocket_workpool_t *self = (msocket_workpool_t*) arg;
+   MUTEX_LOCK(self->mutex);
+   while (1){
+      msocket_t *msocket;
+      uint32_t count;
+      while ( (self->runHead == 0) && (self->stopRequest == 0u) ){
+         pthread_cond_wait(&self->cond, &self->mutex);
+      }
+      if (self->stopRequest != 0u){
+         break;
+      }
+      msocket = self->runHead;
+      msocket_workpool_unrun(self, msocket);
+      msocket->workState = WORK_STATE_RUNNING;
+      msocket->workThread = pthread_self();
+      for (count = 0u; (count < MSOCKET_WORKPOOL_BATCH_SIZE) && (msocket->workHead != 0) && (msocket->workHeld == 0u); count++){
+         msocket_workitem_t *item = msocket->workHead;
+         uint32_t restLen;
+         msocket->workHead = item->next;
+         if (msocket->workHead == 0){
+            msocket->workTail = (msocket_workitem_t*) 0;
+         }
+         MUTEX_UNLOCK(self->mutex);
+         restLen = msocket_ioWork(msocket, &item->data[0], item->len);
+         if (restLen == 0u){
+            free(item);
+         }
+         MUTEX_LOCK(self->mutex);
+         if (restLen != 0u){
+            //reading is paused and the rx ring is full, the rest of the chunk stays first in line until reading resumes
+            memmove(&item->data[0], &item->data[item->len - restLen], restLen);
+            item->len = restLen;
+            item->next = msocket->workHead;
+            msocket->workHead = item;
+            if (msocket->workTail == 0){
+               msocket->workTail = item;
+            }
+            if (msocket_workpool_takeResume(msocket) == 0u){
+               msocket->workHeld = 1u; //msocket_workpool_post of the resume event makes the socket runnable again
+            }
+            continue;
+         }
+         self->queueDepth--;
+         self->numProcessed++;
+      }
+      msocket->workState = WORK_STATE_IDLE;
+      if ( (msocket->workHead != 0) && (msocket->workHeld == 0u) ){
+         msocket_workpool_runnable(self, msocket); //go to the back of the queue to give other sockets a chance
+      }
+      pthread_cond_broadcast(&self->idle);
+   }
+   MUTEX_UNLOCK(self->mutex);
+   THREAD_RETURN(0);
+}
+
+static void msocket_workpool_stop(msocket_workpool_t *self){
+   uint32_t i;
+   MUTEX_LOCK(self->mutex);
+   self->stopRequest = 1u;
+   pthread_cond_broadcast(&self->cond);
+   MUTEX_UNLOCK(self->mutex);
+   for (i = 0u; i < self->numThreads; i++){
+      THREAD_JOIN(self->threads[i]);
+   }
+   self->numThreads = 0u;
+}
+
+/**
+ * Appends msocket to the run queue. Caller must hold the pool mutex.
+ */
+static void msocket_workpool_runnable(msocket_workpool_t *self, msocket_t *msocket){
+   msocket->workNext = (msocket_t*) 0;
+   if (self->runTail == 0){
+      self->runHead = msocket;
+   }
+   else{
+      self->runTail->workNext = msocket;
+   }
+   self->runTail = msocket;
+   msocket->workState = WORK_STATE_QUEUED;
+   self->numRunnable++;
+   pthread_cond_signal(&self->cond);
+}
+
+/**
+ * Removes msocket from the run queue. Caller must hold the pool mutex.
+ */
+static void msocket_workpool_unrun(msocket_workpool_t *self, msocket_t *msocket){
+   msocket_t **pp = &self->runHead;
+   msocket_t *prev = (msocket_t*) 0;
+   while ( (*pp != 0) && (*pp != msocket) ){
+      prev = *pp;
+      pp = &prev->workNext;
+   }
+   assert(*pp == msocket);
+   *pp = msocket->workNext;
+   if (self->runTail == msocket){
+      self->runTail = prev;
+   }
+   msocket->workNext = (msocket_t*) 0;
+   msocket->workState = WORK_STATE_IDLE;
+   self->numRunnable--;
+}
+
+/**
+ * Frees all queued work items of msocket, returns number of freed items. Caller must hold the pool mutex.
+ */
+static uint32_t msocket_workpool_freeItems(msocket_t *msocket){
+   uint32_t count = 0u;
+   while (msocket->workHead != 0){
+      msocket_workitem_t *item = msocket->workHead;
+      msocket->workHead = item->next;
+      free(item);
+      count++;
+   }
+   msocket->workTail = (msocket_workitem_t*) 0;
+   msocket->workHeld = 0u;
+   return count;
+}
+
+/**
+ * Moves a resume event that was queued while a worker was holding back a chunk to the head of the queue.
+ * Returns 1 when there was one. Caller must hold the pool mutex.
+ */
+static uint8_t msocket_workpool_takeResume(msocket_t *msocket){
+   msocket_workitem_t *prev = msocket->workHead;
+   while ( (prev != 0) && (prev->next != 0) ){
+      msocket_workitem_t *item = prev->next;
+      if (item->len == MSOCKET_WORK_RESUME){
+         prev->next = item->next;
+         if (msocket->workTail == item){
+            msocket->workTail = prev;
+         }
+         item->next = msocket->workHead;
+         msocket->workHead = item;
+         return 1u;
+      }
+      prev = item;
+   }
+   return 0u;
+}
+
+#endif //_WIN32